@@ -0,0 +1,252 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "Appender.h"
+
+#ifndef WIN
+#include <cerrno>
+
+static atomic<uint64_t> next_appender_id(1);
+
+struct Appender::ThreadBufferMap
+{
+    ~ThreadBufferMap()
+    {
+        for (const auto &entry : buffers) {
+            const shared_ptr<ThreadBuffer> buffer = entry.second.lock();
+
+            if (!buffer) continue;
+
+            lock_guard<mutex> guard(buffer->lock);
+
+            if (buffer->owner != nullptr) buffer->owner->release(*buffer);
+        }
+    }
+
+    unordered_map<uint64_t, weak_ptr<ThreadBuffer>> buffers;
+};
+
+Appender::
+Appender(const string &path, size_t buffer_size, unsigned int flush_interval_ms, mode_t mode) :
+    fd(open(path.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, mode)),
+    buffer_size(buffer_size),
+    flush_interval(flush_interval_ms),
+    id(next_appender_id++),
+    failed(fd == -1)
+{
+    if (fd != -1 && flush_interval_ms != 0) flusher = thread(&Appender::runFlusher, this);
+}
+
+Appender::
+~Appender()
+{
+    if (flusher.joinable()) {
+        {
+            lock_guard<mutex> guard(flusher_lock);
+            stopping = true;
+        }
+
+        flusher_wakeup.notify_one();
+        flusher.join();
+    }
+
+    DataContainer<shared_ptr<ThreadBuffer>> pending;
+
+    {
+        lock_guard<mutex> guard(buffers_lock);
+        pending = buffers;
+    }
+
+    // Threads exiting later must not touch this appender anymore
+    for (const auto &buffer : pending) {
+        lock_guard<mutex> guard(buffer->lock);
+
+        if (!buffer->data.empty()) write(buffer->data.data(), buffer->data.size());
+
+        buffer->owner = nullptr;
+    }
+
+    if (fd != -1) close(fd);
+}
+
+bool
+Appender::
+isOpen() const
+{
+    return fd != -1;
+}
+
+bool
+Appender::
+append(const string &record)
+{
+    return append(record.data(), record.size());
+}
+
+bool
+Appender::
+append(const char *data, size_t len)
+{
+    if (failed) return false;
+
+    ThreadBuffer &buffer = threadBuffer();
+    lock_guard<mutex> guard(buffer.lock);
+
+    if (buffer.data.size() + len > buffer_size && !buffer.data.empty()) {
+        if (!write(buffer.data.data(), buffer.data.size())) return false;
+
+        buffer.data.clear();
+    }
+
+    // Records not fitting into the buffer at all are written directly
+    if (len >= buffer_size) return write(data, len);
+
+    buffer.data.append(data, len);
+
+    return true;
+}
+
+bool
+Appender::
+flush()
+{
+    DataContainer<shared_ptr<ThreadBuffer>> pending;
+
+    {
+        lock_guard<mutex> guard(buffers_lock);
+        pending = buffers;
+    }
+
+    for (const auto &buffer : pending) {
+        lock_guard<mutex> guard(buffer->lock);
+
+        if (!buffer->data.empty() && write(buffer->data.data(), buffer->data.size())) {
+            buffer->data.clear();
+        }
+    }
+
+    return !failed;
+}
+
+bool
+Appender::
+sync()
+{
+    return flush() && fdatasync(fd) == 0;
+}
+
+Appender::ThreadBuffer &
+Appender::
+threadBuffer()
+{
+    // Buffers of the current thread by appender id. The appender owns them,
+    // so they are released with it or when the thread exits. The last one
+    // used is cached, as most threads write to a single appender.
+    thread_local ThreadBufferMap thread_map;
+    thread_local uint64_t last_id = 0;
+    thread_local ThreadBuffer *last_buffer = nullptr;
+
+    if (last_id == id) return *last_buffer;
+
+    auto &thread_buffers = thread_map.buffers;
+    shared_ptr<ThreadBuffer> buffer = thread_buffers[id].lock();
+
+    if (!buffer) {
+        // Drop the entries of appenders destroyed in the meantime
+        for (auto itr = thread_buffers.begin(); itr != thread_buffers.end();) {
+            if (itr->second.expired() && itr->first != id) {
+                itr = thread_buffers.erase(itr);
+            } else {
+                ++itr;
+            }
+        }
+
+        buffer = make_shared<ThreadBuffer>();
+        buffer->data.reserve(buffer_size);
+        buffer->owner = this;
+        thread_buffers[id] = buffer;
+
+        lock_guard<mutex> guard(buffers_lock);
+        buffers.push_back(buffer);
+    }
+
+    last_id = id;
+    last_buffer = buffer.get();
+
+    return *buffer;
+}
+
+bool
+Appender::
+write(const char *data, size_t len)
+{
+    while (len != 0) {
+        const ssize_t cnt = ::write(fd, data, len);
+
+        if (cnt == -1) {
+            if (errno == EINTR) continue;
+
+            failed = true;
+            return false;
+        }
+
+        data += cnt;
+        len -= static_cast<size_t>(cnt);
+    }
+
+    return true;
+}
+
+// Called with the lock of "buffer" held, by a thread that is exiting
+void
+Appender::
+release(ThreadBuffer &buffer)
+{
+    if (!buffer.data.empty()) write(buffer.data.data(), buffer.data.size());
+
+    buffer.data.clear();
+    buffer.owner = nullptr;
+
+    lock_guard<mutex> guard(buffers_lock);
+
+    buffers.erase(remove_if(buffers.begin(), buffers.end(),
+                            [&](const shared_ptr<ThreadBuffer> &b) { return b.get() == &buffer; }),
+                  buffers.end());
+}
+
+void
+Appender::
+runFlusher()
+{
+    unique_lock<mutex> guard(flusher_lock);
+
+    while (!stopping) {
+        flusher_wakeup.wait_for(guard, flush_interval);
+
+        if (stopping) break;
+
+        guard.unlock();
+        flush();
+        guard.lock();
+    }
+}
+#endif
@@ -0,0 +1,93 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef APPENDER_H
+#define APPENDER_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+// Keeps a file open for appending and collects records in a buffer per
+// thread. A thread only locks its own buffer, so appending threads do not
+// contend with each other. Buffers are written with a single write() when
+// full, by a background thread after "flush_interval_ms" or on flush().
+// Records are never split, as the descriptor uses O_APPEND.
+class FILESYSTEM_EXPORT Appender
+{
+public:
+    explicit Appender(const string &path, size_t buffer_size = 64 * 1024,
+                      unsigned int flush_interval_ms = 1000, mode_t mode = 0644);
+    Appender(const Appender&) = delete;
+    Appender &operator=(const Appender&) = delete;
+    ~Appender();
+
+    bool
+    isOpen              () const,
+    append              (const string &record),
+    append              (const char *data, size_t len),
+    flush               (),
+    sync                ();
+
+private:
+    struct ThreadBuffer
+    {
+        mutex lock;
+        string data;
+        Appender *owner;    // nullptr once the appender is destroyed
+    };
+
+    // Buffers of a thread, released when the thread exits
+    struct ThreadBufferMap;
+
+    ThreadBuffer &
+    threadBuffer        ();
+
+    bool
+    write               (const char *data, size_t len);
+
+    void
+    release             (ThreadBuffer &buffer);
+
+    void
+    runFlusher          ();
+
+    int fd;
+    const size_t buffer_size;
+    const chrono::milliseconds flush_interval;
+    const uint64_t id;
+
+    mutex buffers_lock;
+    DataContainer<shared_ptr<ThreadBuffer>> buffers;
+
+    mutex flusher_lock;
+    condition_variable flusher_wakeup;
+    bool stopping = false;
+    thread flusher;
+
+    atomic<bool> failed;
+};
+#endif
+
+#endif // APPENDER_H
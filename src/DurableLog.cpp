@@ -0,0 +1,183 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "DurableLog.h"
+
+#ifndef WIN
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+
+DurableLog::
+DurableLog(const string &path, unsigned int max_delay_us, size_t max_batch_bytes, mode_t mode) :
+    fd(open(path.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, mode)),
+    max_delay(max_delay_us),
+    max_batch_bytes(max_batch_bytes),
+    failed(fd == -1)
+{
+    // A newly created log could vanish in a crash together with records
+    // already acknowledged, unless its directory entry is durable as well
+    if (fd != -1 && !FileSystem::syncDirectory(FileSystem::getParentPath(path))) failed = true;
+
+    if (!failed) flusher = thread(&DurableLog::runFlusher, this);
+}
+
+DurableLog::
+~DurableLog()
+{
+    if (flusher.joinable()) {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+
+        submitted.notify_one();
+        flusher.join();
+    }
+
+    if (fd != -1) close(fd);
+}
+
+bool
+DurableLog::
+isOpen() const
+{
+    return fd != -1;
+}
+
+uint64_t
+DurableLog::
+submit(const string &record)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (failed || stopping) return 0;
+
+    pending.push_back(record);
+    pending_bytes += record.size();
+
+    // The flusher only needs to know about the first record of a batch
+    // and about a batch growing beyond its limit
+    if (pending.size() == 1 || pending_bytes >= max_batch_bytes) submitted.notify_one();
+
+    return next_sequence++;
+}
+
+uint64_t
+DurableLog::
+durableSequence() const
+{
+    lock_guard<mutex> guard(lock);
+    return durable_sequence;
+}
+
+bool
+DurableLog::
+wait(uint64_t sequence)
+{
+    unique_lock<mutex> guard(lock);
+
+    committed.wait(guard, [&]() { return durable_sequence >= sequence || failed; });
+
+    return durable_sequence >= sequence;
+}
+
+bool
+DurableLog::
+append(const string &record)
+{
+    const uint64_t sequence = submit(record);
+    return sequence != 0 && wait(sequence);
+}
+
+void
+DurableLog::
+runFlusher()
+{
+    DataContainer<string> batch;
+    DataContainer<iovec> iov;
+    unique_lock<mutex> guard(lock);
+
+    for (;;) {
+        submitted.wait(guard, [&]() { return stopping || !pending.empty(); });
+
+        if (pending.empty()) break;
+
+        if (max_delay.count() != 0 && !stopping && pending_bytes < max_batch_bytes) {
+            submitted.wait_for(guard, max_delay, [&]() { return stopping || pending_bytes >= max_batch_bytes; });
+        }
+
+        batch.swap(pending);
+        pending_bytes = 0;
+
+        const uint64_t last_sequence = next_sequence - 1;
+
+        guard.unlock();
+
+        iov.clear();
+
+        for (auto &record : batch) {
+            if (!record.empty()) iov.push_back(iovec {&record[0], record.size()});
+        }
+
+        bool ok = true;
+        size_t first = 0;
+
+        while (ok && first != iov.size()) {
+            const int cnt = static_cast<int>(min<size_t>(iov.size() - first, IOV_MAX));
+            ssize_t written = writev(fd, &iov[first], cnt);
+
+            if (written == -1) {
+                ok = errno == EINTR;
+                continue;
+            }
+
+            // Skip what has been written, a partial write continues within
+            // the current record
+            while (first != iov.size() && static_cast<size_t>(written) >= iov[first].iov_len) {
+                written -= static_cast<ssize_t>(iov[first++].iov_len);
+            }
+
+            if (written != 0) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                iov[first].iov_len -= static_cast<size_t>(written);
+            }
+        }
+
+        ok = ok && fdatasync(fd) == 0;
+
+        batch.clear();
+
+        guard.lock();
+
+        if (ok) {
+            durable_sequence = last_sequence;
+        } else {
+            failed = true;
+        }
+
+        committed.notify_all();
+
+        if (failed) break;
+    }
+}
+#endif
@@ -0,0 +1,79 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef DURABLELOG_H
+#define DURABLELOG_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+#include <condition_variable>
+#include <thread>
+
+// Append-only log with group commit. Any number of threads submit records
+// and receive increasing sequence numbers. A single flusher thread writes
+// all pending records with writev() and makes them durable with one
+// fdatasync(), then wakes every thread waiting for a record of the batch.
+// Waiting up to "max_delay_us" for further records trades latency for
+// fewer syncs; a batch is written early once it reaches "max_batch_bytes".
+class FILESYSTEM_EXPORT DurableLog
+{
+public:
+    explicit DurableLog(const string &path, unsigned int max_delay_us = 0,
+                        size_t max_batch_bytes = 1 << 20, mode_t mode = 0644);
+    DurableLog(const DurableLog&) = delete;
+    DurableLog &operator=(const DurableLog&) = delete;
+    ~DurableLog();
+
+    bool
+    isOpen              () const;
+
+    // Returns the sequence number of the record, 0 after a write error
+    uint64_t
+    submit              (const string &record),
+    durableSequence     () const;
+
+    // Blocks until the record "sequence" is durable, false on write errors
+    bool
+    wait                (uint64_t sequence),
+    append              (const string &record);
+
+private:
+    void
+    runFlusher          ();
+
+    int fd;
+    const chrono::microseconds max_delay;
+    const size_t max_batch_bytes;
+
+    mutable mutex lock;
+    condition_variable submitted, committed;
+
+    DataContainer<string> pending;
+    size_t pending_bytes = 0;
+    uint64_t next_sequence = 1, durable_sequence = 0;
+    bool failed, stopping = false;
+
+    thread flusher;
+};
+#endif
+
+#endif // DURABLELOG_H
@@ -0,0 +1,475 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "FileIndex.h"
+#include "Parallel.h"
+#include <cstdio>
+#include <functional>
+
+static constexpr char INDEX_MAGIC[8] = {'F', 'S', 'I', 'D', 'X', '3', '\0', '\0'};
+
+static void
+collectTrigrams(const char *name, DataContainer<uint32_t> &trigrams)
+{
+    trigrams.clear();
+
+    const size_t len = strlen(name);
+
+    for (size_t i = 0; i + 2 < len; ++i) {
+        trigrams.push_back(static_cast<uint32_t>(static_cast<unsigned char>(name[i])) << 16 |
+                           static_cast<uint32_t>(static_cast<unsigned char>(name[i + 1])) << 8 |
+                           static_cast<uint32_t>(static_cast<unsigned char>(name[i + 2])));
+    }
+
+    sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+static void
+walkTree(const string &path, DataContainer<string> &paths)
+{
+    DataContainer<string> pending {path};
+
+    while (!pending.empty()) {
+        DirectoryRange entries(pending.back());
+        pending.pop_back();
+
+        for (const auto &entry : entries) {
+            paths.push_back(entry);
+
+            bool is_dir = entries.type() == DT_DIR;
+
+            if (entries.type() == DT_UNKNOWN) {
+                struct stat st {};
+                is_dir = lstat(entry.data(), &st) == 0 && S_ISDIR(st.st_mode);
+            }
+
+            if (is_dir) pending.push_back(entry);
+        }
+    }
+}
+
+template<typename T>
+static bool
+writeArray(FILE *fp, const DataContainer<T> &array)
+{
+    return array.empty() || fwrite(array.data(), sizeof(T), array.size(), fp) == array.size();
+}
+
+template<typename T>
+static bool
+readArray(FILE *fp, DataContainer<T> &array, uint64_t size)
+{
+    array.resize(size);
+    return size == 0 || fread(&array[0], sizeof(T), size, fp) == size;
+}
+
+bool
+FileIndex::
+build(const string &root_path, unsigned int threads)
+{
+    if (!FileSystem::isDir(root_path)) return false;
+
+    // The top level directories are distributed over the worker threads
+    // one at a time, the paths of each subtree are collected separately
+    DataContainer<string> top_level;
+    DataContainer<DataContainer<string>> collected(1);
+    DirectoryRange entries(root_path);
+
+    for (const auto &entry : entries) {
+        collected.front().push_back(entry);
+
+        if (entries.type() == DT_DIR || (entries.type() == DT_UNKNOWN && FileSystem::isDir(entry, false))) {
+            top_level.push_back(entry);
+        }
+    }
+
+    collected.resize(top_level.size() + 1);
+
+    runParallel(top_level.size(), threads, [&](size_t i) {
+        walkTree(top_level[i], collected[i + 1]);
+    }, 1);
+
+    DataContainer<string> paths;
+
+    for (auto &part : collected) {
+        paths.insert(paths.end(), make_move_iterator(part.begin()), make_move_iterator(part.end()));
+        DataContainer<string>().swap(part);
+    }
+
+    assign(move(paths));
+
+    return true;
+}
+
+void
+FileIndex::
+assign(DataContainer<string> paths)
+{
+    sort(paths.begin(), paths.end());
+    paths.erase(unique(paths.begin(), paths.end()), paths.end());
+
+    arena.clear();
+    path_offsets.clear();
+    path_offsets.reserve(paths.size());
+
+    for (const auto &path : paths) {
+        path_offsets.push_back(arena.size());
+        arena.append(path).push_back('\0');
+    }
+
+    DataContainer<string>().swap(paths);
+
+    // Counting sort over the 2^24 possible trigrams. Ids are visited in
+    // ascending order, so every posting list ends up sorted.
+    DataContainer<uint32_t> counts(1 << 24, 0);
+    DataContainer<uint32_t> trigrams;
+
+    for (uint32_t id = 0; id != path_offsets.size(); ++id) {
+        collectTrigrams(baseName(id), trigrams);
+
+        for (const uint32_t trigram : trigrams) ++counts[trigram];
+    }
+
+    trigram_keys.clear();
+    posting_offsets.assign(1, 0);
+
+    for (uint32_t trigram = 0; trigram != counts.size(); ++trigram) {
+        if (counts[trigram] == 0) continue;
+
+        posting_offsets.push_back(posting_offsets.back() + counts[trigram]);
+
+        // From now on the position of the trigram in trigram_keys
+        counts[trigram] = static_cast<uint32_t>(trigram_keys.size());
+        trigram_keys.push_back(trigram);
+    }
+
+    // Position to insert the next id at for every trigram
+    DataContainer<uint64_t> next(posting_offsets.begin(), posting_offsets.end() - 1);
+
+    postings.resize(posting_offsets.back());
+
+    for (uint32_t id = 0; id != path_offsets.size(); ++id) {
+        collectTrigrams(baseName(id), trigrams);
+
+        for (const uint32_t trigram : trigrams) postings[next[counts[trigram]]++] = id;
+    }
+
+    added.clear();
+    removed.clear();
+}
+
+bool
+FileIndex::
+save(const string &index_path)
+{
+    compact();
+
+    const string tmp_path = index_path + ".tmp";
+    FILE * const fp = fopen(tmp_path.data(), "we");
+
+    if (fp == nullptr) return false;
+
+    const uint64_t header[4] = {path_offsets.size(), arena.size(), trigram_keys.size(), postings.size()};
+
+    bool ok = fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, fp) == 1 &&
+              fwrite(header, sizeof(header), 1, fp) == 1 &&
+              writeArray(fp, path_offsets) &&
+              fwrite(arena.data(), 1, arena.size(), fp) == arena.size() &&
+              writeArray(fp, trigram_keys) &&
+              writeArray(fp, posting_offsets) &&
+              writeArray(fp, postings);
+
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok) {
+        FileSystem::deleteFile(tmp_path);
+        return false;
+    }
+
+    return FileSystem::rename(tmp_path, index_path);
+}
+
+bool
+FileIndex::
+load(const string &index_path)
+{
+    FILE * const fp = fopen(index_path.data(), "re");
+
+    if (fp == nullptr) return false;
+
+    char magic[sizeof(INDEX_MAGIC)];
+    uint64_t header[4];
+    struct stat st {};
+
+    bool ok = fstat(fileno(fp), &st) == 0 &&
+              fread(magic, sizeof(magic), 1, fp) == 1 &&
+              memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0 &&
+              fread(header, sizeof(header), 1, fp) == 1;
+
+    // The arrays have to fit into the file, before anything is allocated
+    if (ok) {
+        const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+
+        ok = header[0] <= file_size / sizeof(uint64_t) && header[1] <= file_size &&
+             header[2] <= file_size / sizeof(uint32_t) && header[3] <= file_size / sizeof(uint32_t) &&
+             sizeof(magic) + sizeof(header) + header[0] * sizeof(uint64_t) + header[1] +
+             (header[2] + header[3]) * sizeof(uint32_t) + (header[2] + 1) * sizeof(uint64_t) == file_size;
+    }
+
+    ok = ok && readArray(fp, path_offsets, header[0]);
+
+    if (ok) {
+        arena.resize(header[1]);
+        ok = header[1] == 0 || fread(&arena[0], 1, header[1], fp) == header[1];
+    }
+
+    ok = ok &&
+         readArray(fp, trigram_keys, header[2]) &&
+         readArray(fp, posting_offsets, header[2] + 1) &&
+         readArray(fp, postings, header[3]);
+
+    fclose(fp);
+
+    // Reject truncated or inconsistent files
+    ok = ok &&
+         (arena.empty() || arena.back() == '\0') &&
+         all_of(path_offsets.begin(), path_offsets.end(), [&](uint64_t offset) { return offset < arena.size(); }) &&
+         adjacent_find(trigram_keys.begin(), trigram_keys.end(), greater_equal<uint32_t>()) == trigram_keys.end() &&
+         posting_offsets.front() == 0 &&
+         is_sorted(posting_offsets.begin(), posting_offsets.end()) &&
+         posting_offsets.back() == postings.size() &&
+         all_of(postings.begin(), postings.end(), [&](uint32_t id) { return id < path_offsets.size(); });
+
+    added.clear();
+    removed.clear();
+
+    if (!ok) {
+        arena.clear();
+        path_offsets.clear();
+        trigram_keys.clear();
+        posting_offsets.assign(1, 0);
+        postings.clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+FileIndex::
+add(const string &path)
+{
+    if (removed.erase(path) != 0 || contains(path)) return;
+
+    added.insert(path);
+}
+
+void
+FileIndex::
+remove(const string &path)
+{
+    if (added.erase(path) != 0 || !contains(path)) return;
+
+    removed.insert(path);
+}
+
+void
+FileIndex::
+compact()
+{
+    if (added.empty() && removed.empty()) return;
+
+    DataContainer<string> paths(added.begin(), added.end());
+
+    for (uint32_t id = 0; id != path_offsets.size(); ++id) {
+        if (!isRemoved(&arena[path_offsets[id]])) paths.emplace_back(&arena[path_offsets[id]]);
+    }
+
+    assign(move(paths));
+}
+
+size_t
+FileIndex::
+size() const
+{
+    return path_offsets.size() + added.size() - removed.size();
+}
+
+DataContainer<string>
+FileIndex::
+findSubstring(const string &needle) const
+{
+    DataContainer<string> matches;
+
+    for (const uint32_t id : candidates(needle)) {
+        if (strstr(baseName(id), needle.data()) != nullptr && !isRemoved(path(id))) {
+            matches.push_back(path(id));
+        }
+    }
+
+    for (const auto &path : added) {
+        if (FileSystem::getBaseName(path).find(needle) != string::npos) matches.push_back(path);
+    }
+
+    sort(matches.begin(), matches.end());
+
+    return matches;
+}
+
+DataContainer<string>
+FileIndex::
+findPattern(const string &pattern) const
+{
+    // The longest run of literal characters outside of wildcards, bracket
+    // expressions and brace alternatives has to occur in every match
+    string literal, longest;
+    size_t depth = 0;
+
+    for (size_t i = 0; i <= pattern.size(); ++i) {
+        const char c = i != pattern.size() ? pattern[i] : '*';
+
+        if (c == '{') {
+            ++depth;
+        } else if (c == '}' && depth != 0) {
+            --depth;
+        } else if (depth == 0 && c == '[') {
+            i = pattern.find(']', i + 2);
+            if (i == string::npos) i = pattern.size() - 1;
+        } else if (depth == 0 && c != '*' && c != '?') {
+#ifndef WIN
+            if (c == '\\' && i + 1 != pattern.size()) {
+                literal += pattern[++i];
+                continue;
+            }
+#endif
+            literal += c;
+            continue;
+        }
+
+        if (literal.size() > longest.size()) longest = literal;
+
+        literal.clear();
+    }
+
+    DataContainer<string> matches;
+
+    for (const uint32_t id : candidates(longest)) {
+        if (FileSystem::matchesPattern(pattern, baseName(id)) && !isRemoved(path(id))) {
+            matches.push_back(path(id));
+        }
+    }
+
+    for (const auto &path : added) {
+        if (FileSystem::matchesPattern(pattern, FileSystem::getBaseName(path))) matches.push_back(path);
+    }
+
+    sort(matches.begin(), matches.end());
+
+    return matches;
+}
+
+DataContainer<uint32_t>
+FileIndex::
+candidates(const string &literal) const
+{
+    DataContainer<uint32_t> ids;
+
+    // Too short for a trigram lookup, every name is a candidate
+    if (literal.size() < 3) {
+        ids.resize(path_offsets.size());
+
+        for (uint32_t id = 0; id != ids.size(); ++id) ids[id] = id;
+
+        return ids;
+    }
+
+    DataContainer<uint32_t> trigrams;
+    collectTrigrams(literal.data(), trigrams);
+
+    DataContainer<pair<uint64_t, uint64_t>> lists;
+
+    for (const uint32_t trigram : trigrams) {
+        const auto itr = lower_bound(trigram_keys.begin(), trigram_keys.end(), trigram);
+
+        if (itr == trigram_keys.end() || *itr != trigram) return ids;
+
+        const size_t i = static_cast<size_t>(itr - trigram_keys.begin());
+        lists.emplace_back(posting_offsets[i], posting_offsets[i + 1]);
+    }
+
+    // Intersect starting with the shortest posting list
+    sort(lists.begin(), lists.end(), [](const pair<uint64_t, uint64_t> &a, const pair<uint64_t, uint64_t> &b) {
+        return a.second - a.first < b.second - b.first;
+    });
+
+    ids.assign(postings.begin() + lists.front().first, postings.begin() + lists.front().second);
+
+    for (auto list = lists.begin() + 1; list != lists.end() && !ids.empty(); ++list) {
+        DataContainer<uint32_t> intersection;
+
+        set_intersection(ids.begin(), ids.end(),
+                         postings.begin() + list->first, postings.begin() + list->second,
+                         back_inserter(intersection));
+
+        ids.swap(intersection);
+    }
+
+    return ids;
+}
+
+string
+FileIndex::
+path(uint32_t id) const
+{
+    return &arena[path_offsets[id]];
+}
+
+const char *
+FileIndex::
+baseName(uint32_t id) const
+{
+    const char * const path = &arena[path_offsets[id]];
+    const char * const sep = strrchr(path, DIR_SEP[0]);
+
+    return sep != nullptr ? sep + 1 : path;
+}
+
+bool
+FileIndex::
+contains(const string &path) const
+{
+    const auto itr = lower_bound(path_offsets.begin(), path_offsets.end(), path,
+                                 [&](uint64_t offset, const string &p) { return strcmp(&arena[offset], p.data()) < 0; });
+
+    return itr != path_offsets.end() && path == &arena[*itr];
+}
+
+bool
+FileIndex::
+isRemoved(const string &path) const
+{
+    return removed.count(path) != 0;
+}
@@ -0,0 +1,84 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include "FileSystem.h"
+#include <unordered_set>
+
+// Name index over a directory tree. Paths are stored sorted in a single
+// arena, base names are indexed by their trigrams, so substring and
+// pattern queries only verify the candidates sharing all trigrams of the
+// query. Changes can be applied incrementally with add() and remove(),
+// e.g. from inotify events or snapshot diffs, and are merged by compact().
+class FILESYSTEM_EXPORT FileIndex
+{
+public:
+    bool
+    build               (const string &root_path, unsigned int threads = 0),
+    load                (const string &index_path),
+    save                (const string &index_path);
+
+    void
+    add                 (const string &path),
+    remove              (const string &path),
+    compact             ();
+
+    DataContainer<string>
+    findSubstring       (const string &needle) const,
+    findPattern         (const string &pattern) const;
+
+    size_t
+    size                () const;
+
+private:
+    void
+    assign              (DataContainer<string> paths);
+
+    DataContainer<uint32_t>
+    candidates          (const string &literal) const;
+
+    string
+    path                (uint32_t id) const;
+
+    const char *
+    baseName            (uint32_t id) const;
+
+    bool
+    contains            (const string &path) const,
+    isRemoved           (const string &path) const;
+
+    // Paths separated by '\0', sorted
+    string arena;
+    DataContainer<uint64_t> path_offsets;
+
+    // Trigram postings in compressed sparse row layout: the ids of all
+    // base names containing trigram_keys[i] are
+    // postings[posting_offsets[i] .. posting_offsets[i+1])
+    DataContainer<uint32_t> trigram_keys, postings;
+    DataContainer<uint64_t> posting_offsets;
+
+    // Pending changes, merged into the sorted arrays by compact()
+    unordered_set<string> added, removed;
+};
+
+#endif // FILEINDEX_H
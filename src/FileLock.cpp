@@ -0,0 +1,189 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "FileLock.h"
+
+#ifndef WIN
+#include <cerrno>
+#include <chrono>
+#include <sys/file.h>
+#include <thread>
+
+FileLock::
+FileLock(int fd, Mode mode, off_t offset, off_t length, int timeout_ms) :
+    fd(fd),
+    owns_fd(false),
+    offset(offset),
+    length(length)
+{
+    lock(mode, timeout_ms);
+}
+
+FileLock::
+FileLock(const string &path, Mode mode, off_t offset, off_t length, int timeout_ms) :
+    fd(open(path.data(), (mode == SHARED ? O_RDONLY : O_RDWR) | O_CREAT | O_CLOEXEC, 0644)),
+    owns_fd(true),
+    offset(offset),
+    length(length)
+{
+    if (fd == -1) {
+        lock_error.assign(errno, generic_category());
+        return;
+    }
+
+    lock(mode, timeout_ms);
+}
+
+FileLock::
+FileLock(FileLock &&other) :
+    fd(other.fd),
+    owns_fd(other.owns_fd),
+    offset(other.offset),
+    length(other.length),
+    kind(other.kind),
+    lock_error(other.lock_error)
+{
+    other.fd = -1;
+    other.owns_fd = false;
+    other.kind = NONE;
+}
+
+FileLock::
+~FileLock()
+{
+    unlock();
+
+    if (owns_fd && fd != -1) close(fd);
+}
+
+bool
+FileLock::
+isLocked() const
+{
+    return kind != NONE;
+}
+
+const error_code &
+FileLock::
+error() const
+{
+    return lock_error;
+}
+
+void
+FileLock::
+unlock()
+{
+    if (kind == FLOCK) {
+        flock(fd, LOCK_UN);
+    } else if (kind != NONE) {
+        struct flock range {};
+        range.l_type = F_UNLCK;
+        range.l_whence = SEEK_SET;
+        range.l_start = offset;
+        range.l_len = length;
+
+#ifdef F_OFD_SETLK
+        fcntl(fd, kind == OFD ? F_OFD_SETLK : F_SETLK, &range);
+#else
+        fcntl(fd, F_SETLK, &range);
+#endif
+    }
+
+    kind = NONE;
+}
+
+void
+FileLock::
+lock(Mode mode, int timeout_ms)
+{
+    if (timeout_ms <= 0) {
+        tryLock(mode, timeout_ms < 0);
+        return;
+    }
+
+    // Kernel locks cannot time out, retry with growing pauses instead
+    const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    chrono::milliseconds pause(1);
+
+    while (!tryLock(mode, false) && lock_error == errc::resource_unavailable_try_again) {
+        const auto now = chrono::steady_clock::now();
+
+        if (now >= deadline) {
+            lock_error = make_error_code(errc::timed_out);
+            return;
+        }
+
+        this_thread::sleep_for(min<chrono::steady_clock::duration>(pause, deadline - now));
+        pause = min(pause * 2, chrono::milliseconds(50));
+    }
+}
+
+bool
+FileLock::
+tryLock(Mode mode, bool wait)
+{
+    struct flock range {};
+    range.l_type = mode == SHARED ? F_RDLCK : F_WRLCK;
+    range.l_whence = SEEK_SET;
+    range.l_start = offset;
+    range.l_len = length;
+
+    int res;
+
+#ifdef F_OFD_SETLK
+    while ((res = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &range)) == -1 && errno == EINTR);
+
+    if (res == 0) {
+        kind = OFD;
+        lock_error.clear();
+        return true;
+    }
+
+    // Kernels before 3.15 do not know open file description locks
+    if (errno != EINVAL) {
+        lock_error.assign(errno == EACCES ? EAGAIN : errno, generic_category());
+        return false;
+    }
+#endif
+
+    if (offset == 0 && length == 0) {
+        const int operation = (mode == SHARED ? LOCK_SH : LOCK_EX) | (wait ? 0 : LOCK_NB);
+
+        while ((res = flock(fd, operation)) == -1 && errno == EINTR);
+
+        kind = res == 0 ? FLOCK : NONE;
+    } else {
+        while ((res = fcntl(fd, wait ? F_SETLKW : F_SETLK, &range)) == -1 && errno == EINTR);
+
+        kind = res == 0 ? POSIX : NONE;
+    }
+
+    if (res == 0) {
+        lock_error.clear();
+        return true;
+    }
+
+    lock_error.assign(errno == EACCES || errno == EWOULDBLOCK ? EAGAIN : errno, generic_category());
+    return false;
+}
+#endif
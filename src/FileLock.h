@@ -0,0 +1,74 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef FILELOCK_H
+#define FILELOCK_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+// Shared or exclusive lock of a byte range of a file, released on
+// destruction. Uses open file description locks where available, so locks
+// held through different descriptors conflict even within one process and
+// closing another descriptor of the file does not release them. Whole file
+// locks fall back to flock(), ranges to process-associated record locks.
+//
+// "length" 0 locks up to the end of the file, however it grows.
+// "timeout_ms" -1 blocks, 0 only tries, otherwise retries until it expires.
+class FILESYSTEM_EXPORT FileLock
+{
+public:
+    enum Mode {SHARED, EXCLUSIVE};
+
+    FileLock(int fd, Mode mode, off_t offset = 0, off_t length = 0, int timeout_ms = -1);
+    FileLock(const string &path, Mode mode, off_t offset = 0, off_t length = 0, int timeout_ms = -1);
+    FileLock(FileLock &&other);
+    FileLock(const FileLock&) = delete;
+    FileLock &operator=(const FileLock&) = delete;
+    ~FileLock();
+
+    bool
+    isLocked            () const;
+
+    const error_code &
+    error               () const;
+
+    void
+    unlock              ();
+
+private:
+    enum Kind {NONE, OFD, FLOCK, POSIX};
+
+    void
+    lock                (Mode mode, int timeout_ms);
+
+    bool
+    tryLock             (Mode mode, bool wait);
+
+    int fd;
+    bool owns_fd;
+    off_t offset, length;
+    Kind kind = NONE;
+    error_code lock_error;
+};
+#endif
+
+#endif // FILELOCK_H
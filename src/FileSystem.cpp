@@ -20,245 +20,2245 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 
 
 #include "FileSystem.h"
+#include "Parallel.h"
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <queue>
+#include <regex>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+// Layout of the records returned by getdents64()
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+#ifndef WIN
+static ssize_t
+preadFull(int fd, char *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+
+    while (done != len) {
+        const ssize_t cnt = pread(fd, buf + done, len - done, offset + static_cast<off_t>(done));
+
+        if (cnt == 0) break;
+        if (cnt == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        done += static_cast<size_t>(cnt);
+    }
+
+    return static_cast<ssize_t>(done);
+}
+
+// Like preadFull() from the current position, works for pipes as well
+static ssize_t
+readFull(int fd, char *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done != len) {
+        const ssize_t cnt = read(fd, buf + done, len - done);
+
+        if (cnt == 0) break;
+        if (cnt == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        done += static_cast<size_t>(cnt);
+    }
+
+    return static_cast<ssize_t>(done);
+}
+
+static bool
+pwriteFull(int fd, const char *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+
+    while (done != len) {
+        const ssize_t cnt = pwrite(fd, buf + done, len - done, offset + static_cast<off_t>(done));
+
+        if (cnt == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        done += static_cast<size_t>(cnt);
+    }
+
+    return true;
+}
+#endif
+
+// Stores the cause of a failure, errno is thread local, so no locking is
+// involved. Returns false for use in return statements.
+static bool
+setError(error_code &error, int err)
+{
+    error.assign(err != 0 ? err : EIO, generic_category());
+    return false;
+}
+
+static uint32_t
+adler32(uint32_t adler, const char *buf, size_t len)
+{
+    constexpr uint32_t MOD_ADLER = 65521;
+    constexpr size_t NMAX = 5552;
+
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+
+    while (len != 0) {
+        size_t n = min(len, NMAX);
+        len -= n;
+
+        while (n-- != 0) {
+            a += static_cast<uint8_t>(*buf++);
+            b += a;
+        }
+
+        a %= MOD_ADLER;
+        b %= MOD_ADLER;
+    }
+
+    return (b << 16) | a;
+}
+
+#ifndef WIN
+// State of an interrupted copyFileResumable() call. "source_*" identify
+// the version of the source, "checksum" is the running Adler-32 of all
+// committed bytes, "tail_*" describe the last committed block, which is
+// verified again before resuming.
+struct CopyCheckpoint
+{
+    int64_t source_size, source_mtime, source_mtime_nsec;
+    uint64_t source_ino;
+    int64_t offset;
+    uint32_t checksum, tail_checksum;
+    uint64_t tail_length;
+};
+
+static bool
+isSameSource(const CopyCheckpoint &cp, const struct stat &st)
+{
+    return cp.source_size == st.st_size &&
+           cp.source_mtime == st.st_mtim.tv_sec &&
+           cp.source_mtime_nsec == st.st_mtim.tv_nsec &&
+           cp.source_ino == static_cast<uint64_t>(st.st_ino);
+}
+
+static bool
+readCheckpoint(const string &path, CopyCheckpoint &cp)
+{
+    FILE * const fp = fopen(path.data(), "re");
+
+    if (fp == nullptr) return false;
+
+    const int cnt = fscanf(fp, "FSCHK2 %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNu64 " %" SCNd64
+                           " %" SCNu32 " %" SCNu32 " %" SCNu64,
+                           &cp.source_size, &cp.source_mtime, &cp.source_mtime_nsec, &cp.source_ino, &cp.offset,
+                           &cp.checksum, &cp.tail_checksum, &cp.tail_length);
+    fclose(fp);
+
+    return cnt == 8;
+}
+
+static bool
+writeCheckpoint(const string &path, const CopyCheckpoint &cp)
+{
+    const string tmp_path = path + ".tmp";
+    FILE * const fp = fopen(tmp_path.data(), "we");
+
+    if (fp == nullptr) return false;
+
+    bool ok = fprintf(fp, "FSCHK2 %" PRId64 " %" PRId64 " %" PRId64 " %" PRIu64 " %" PRId64
+                      " %" PRIu32 " %" PRIu32 " %" PRIu64 "\n",
+                      cp.source_size, cp.source_mtime, cp.source_mtime_nsec, cp.source_ino, cp.offset,
+                      cp.checksum, cp.tail_checksum, cp.tail_length) > 0;
+
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    ok = fclose(fp) == 0 && ok;
+
+    return ok && std::rename(tmp_path.data(), path.data()) == 0;
+}
+#endif
+
+#ifndef WIN
+static const char *
+findLastNewline(const char *data, size_t len)
+{
+#ifdef __GLIBC__
+    // Vectorized in glibc
+    return static_cast<const char*>(memrchr(data, '\n', len));
+#else
+    for (const char *p = data + len; p != data;)
+        if (*--p == '\n') return p;
+
+    return nullptr;
+#endif
+}
+#endif
+
+// Orders names like "file2" before "file10". Names that only differ in
+// leading zeros are ordered lexicographically, so the order stays total.
+static bool
+naturalLess(const string &a, const string &b)
+{
+    size_t i = 0, j = 0;
+
+    while (i != a.size() && j != b.size()) {
+        if (isdigit(static_cast<unsigned char>(a[i])) && isdigit(static_cast<unsigned char>(b[j]))) {
+            while (i != a.size() && a[i] == '0') ++i;
+            while (j != b.size() && b[j] == '0') ++j;
+
+            size_t a_end = i, b_end = j;
+
+            while (a_end != a.size() && isdigit(static_cast<unsigned char>(a[a_end]))) ++a_end;
+            while (b_end != b.size() && isdigit(static_cast<unsigned char>(b[b_end]))) ++b_end;
+
+            if (a_end - i != b_end - j) return a_end - i < b_end - j;
+
+            const int cmp = a.compare(i, a_end - i, b, j, b_end - j);
+
+            if (cmp != 0) return cmp < 0;
+
+            i = a_end;
+            j = b_end;
+        } else {
+            if (a[i] != b[j]) return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[j]);
+
+            ++i;
+            ++j;
+        }
+    }
+
+    if (i != a.size() || j != b.size()) return j != b.size();
+
+    return a < b;
+}
+
+// A single path component of a compiled glob pattern
+struct GlobSegment
+{
+    string pattern;
+    bool literal, recursive;
+};
+
+static bool
+isGlobEscape(char c)
+{
+#ifdef WIN
+    (void)c;
+    return false;
+#else
+    return c == '\\';
+#endif
+}
+
+// Expands the first top level brace group of "pattern" and recurses into
+// the alternatives, e.g. "a{b,c{d,e}}" -> "ab", "acd", "ace"
+static void
+expandBraces(const string &pattern, DataContainer<string> &patterns)
+{
+    size_t open = string::npos;
+    size_t depth = 0;
+    DataContainer<size_t> commas;
+
+    for (size_t i = 0; i != pattern.size(); ++i) {
+        const char c = pattern[i];
+
+        if (isGlobEscape(c)) {
+            ++i;
+        } else if (c == '{') {
+            if (depth++ == 0) {
+                open = i;
+                commas.clear();
+            }
+        } else if (c == ',' && depth == 1) {
+            commas.push_back(i);
+        } else if (c == '}' && depth != 0 && --depth == 0) {
+            // "{a}" is not an alternation and is taken literally
+            if (commas.empty()) continue;
+
+            const string prefix = pattern.substr(0, open);
+            const string suffix = pattern.substr(i + 1);
+            size_t begin = open + 1;
+
+            commas.push_back(i);
+
+            for (const size_t end : commas) {
+                expandBraces(prefix + pattern.substr(begin, end - begin) + suffix, patterns);
+                begin = end + 1;
+            }
+
+            return;
+        }
+    }
+
+    patterns.push_back(pattern);
+}
+
+// Matches "c" against the bracket expression starting after '[' and moves
+// "p" behind the closing ']'. Returns false for unterminated expressions.
+static bool
+matchGlobBracket(const char *&p, char c, bool &matched)
+{
+    const char *q = p;
+    const bool negate = *q == '!' || *q == '^';
+
+    if (negate) ++q;
+
+    matched = false;
+
+    for (bool first = true; *q != '\0' && (first || *q != ']'); first = false) {
+        char lo = *q++;
+
+        if (isGlobEscape(lo) && *q != '\0') lo = *q++;
+
+        char hi = lo;
+
+        if (*q == '-' && q[1] != ']' && q[1] != '\0') {
+            hi = q[1];
+            q += 2;
+
+            if (isGlobEscape(hi) && *q != '\0') hi = *q++;
+        }
+
+        if (lo <= c && c <= hi) matched = true;
+    }
+
+    if (*q != ']') return false;
+
+    p = q + 1;
+    matched = matched != negate;
+
+    return true;
+}
+
+static bool
+matchGlobSegment(const char *p, const char *n)
+{
+    const char *star_p = nullptr;
+    const char *star_n = nullptr;
+
+    while (*n != '\0') {
+        bool matched = false;
+
+        if (*p == '*') {
+            star_p = ++p;
+            star_n = n;
+            continue;
+        }
+
+        if (*p == '?') {
+            ++p;
+            matched = true;
+        } else if (*p == '[') {
+            const char *q = p + 1;
+
+            if (matchGlobBracket(q, *n, matched)) {
+                if (matched) p = q;
+            } else if ((matched = *n == '[')) {
+                ++p;
+            }
+        } else {
+            const char *q = isGlobEscape(*p) && p[1] != '\0' ? p + 1 : p;
+
+            if ((matched = *q != '\0' && *q == *n)) p = q + 1;
+        }
+
+        if (matched) {
+            ++n;
+            continue;
+        }
+
+        if (star_p == nullptr) return false;
+
+        p = star_p;
+        n = ++star_n;
+    }
+
+    while (*p == '*') ++p;
+
+    return *p == '\0';
+}
+
+static GlobSegment
+compileGlobSegment(const string &component)
+{
+    GlobSegment segment {component, true, component == "**"};
+    string literal;
+
+    for (size_t i = 0; i != component.size(); ++i) {
+        const char c = component[i];
+
+        if (isGlobEscape(c) && i + 1 != component.size()) {
+            literal += component[++i];
+        } else if (c == '*' || c == '?' || c == '[') {
+            segment.literal = false;
+            break;
+        } else {
+            literal += c;
+        }
+    }
+
+    if (segment.literal) segment.pattern = literal;
+
+    return segment;
+}
+
+static string
+joinGlobPath(const string &base, const char *name)
+{
+    if (base.empty()) return name;
+    if (base.back() == DIR_SEP[0]) return base + name;
+
+    return base + DIR_SEP + name;
+}
+
+// The subdirectories of the first "**" reached are walked in parallel,
+// everything below them sequentially
+static void
+globWalk(const string &base, const DataContainer<GlobSegment> &segments,
+         size_t index, DataContainer<string> &matches, bool parallel = true)
+{
+    if (index == segments.size()) {
+        matches.push_back(base);
+        return;
+    }
+
+    const GlobSegment &segment = segments[index];
+    const bool last = index + 1 == segments.size();
+
+    // Literal components are probed directly instead of listing "base"
+    if (segment.literal) {
+        const string path = joinGlobPath(base, segment.pattern.data());
+
+        if (last ? FileSystem::exists(path) : FileSystem::isDir(path)) {
+            globWalk(path, segments, index + 1, matches, parallel);
+        }
+
+        return;
+    }
+
+    // "**" matches zero or more directories
+    if (segment.recursive) {
+        if (last) {
+            if (!base.empty()) matches.push_back(base);
+        } else {
+            globWalk(base, segments, index + 1, matches, false);
+        }
+    }
+
+    DIR * const dir = opendir(base.empty() ? "." : base.data());
+
+    if (dir == nullptr) return;
+
+    DataContainer<string> subdirs;
+    dirent *entry;
+
+    while (bool(entry = readdir(dir))) {
+        const char * const name = static_cast<char*>(entry->d_name);
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        // Wildcards do not match hidden entries
+        if (name[0] == '.' && (segment.recursive || segment.pattern.front() != '.')) continue;
+
+        if (!segment.recursive && !matchGlobSegment(segment.pattern.data(), name)) continue;
+
+        const string path = joinGlobPath(base, name);
+
+        if (last && !segment.recursive) {
+            matches.push_back(path);
+            continue;
+        }
+
+        // Descend into real directories only, "**" must not follow
+        // symbolic links to avoid loops
+        bool is_dir;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type != DT_UNKNOWN)
+            is_dir = entry->d_type == DT_DIR || (!segment.recursive && entry->d_type == DT_LNK && FileSystem::isDir(path));
+        else
+#endif
+        {
+            struct stat st {};
+            is_dir = lstat(path.data(), &st) == 0 &&
+                     (S_ISDIR(st.st_mode) || (!segment.recursive && S_ISLNK(st.st_mode) && FileSystem::isDir(path)));
+        }
+
+        if (!is_dir) {
+            if (last) matches.push_back(path);
+        } else if (segment.recursive && parallel) {
+            subdirs.push_back(path);
+        } else if (segment.recursive) {
+            globWalk(path, segments, index, matches, false);
+        } else {
+            globWalk(path, segments, index + 1, matches, parallel);
+        }
+    }
+
+    closedir(dir);
+
+    if (subdirs.empty()) return;
+
+    DataContainer<DataContainer<string>> found(subdirs.size());
+
+    runParallel(subdirs.size(), 0, [&](size_t i) {
+        globWalk(subdirs[i], segments, index, found[i], false);
+    }, 1);
+
+    for (auto &part : found) matches.insert(matches.end(), make_move_iterator(part.begin()), make_move_iterator(part.end()));
+}
+
+#ifndef WIN
+static int64_t
+diskUsage(const string &path, bool follow_symlinks, InodeSet &inodes, InodeSet &directories)
+{
+    struct stat st {};
+
+    if ((follow_symlinks ? stat(path.data(), &st) : lstat(path.data(), &st)) != 0) return 0;
+
+    if (S_ISDIR(st.st_mode)) {
+        // A directory reached twice is a symbolic link loop
+        if (!directories.insert(st)) return 0;
+    } else if (!inodes.insert(st)) {
+        return 0;
+    }
+
+    int64_t usage = static_cast<int64_t>(st.st_blocks) * 512;
+
+    if (S_ISDIR(st.st_mode)) {
+        for (const auto &entry : DirectoryRange(path)) {
+            usage += diskUsage(entry, follow_symlinks, inodes, directories);
+        }
+    }
+
+    return usage;
+}
+
+static bool
+copyTreeEntry(const string &source_path, const string &target_path, InodeSet &inodes)
+{
+    struct stat st {};
+
+    if (lstat(source_path.data(), &st) != 0) return false;
+
+    if (S_ISDIR(st.st_mode)) {
+        // The final mode is set once the directory is filled, a read-only
+        // one could not take any entries otherwise
+        const bool created = !FileSystem::isDir(target_path);
+
+        if (created && mkdir(target_path.data(), 0700) != 0) return false;
+
+        bool ok = true;
+
+        for (const auto &entry : DirectoryRange(source_path)) {
+            ok = copyTreeEntry(entry, target_path + DIR_SEP + FileSystem::getBaseName(entry), inodes) && ok;
+        }
+
+        return (!created || chmod(target_path.data(), st.st_mode & 07777) == 0) && ok;
+    }
+
+    // Hard links are reproduced as links to the first copy
+    string first_target;
+
+    if (st.st_nlink > 1 && !inodes.insert(st, target_path, &first_target)) {
+        return link(first_target.data(), target_path.data()) == 0;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        string link_target;
+
+        return FileSystem::readLink(source_path, link_target) &&
+               symlink(link_target.data(), target_path.data()) == 0;
+    }
+
+    if (!S_ISREG(st.st_mode)) return false;
+
+    return FileSystem::copyFile(source_path, target_path) && chmod(target_path.data(), st.st_mode & 07777) == 0;
+}
+
+// Copies everything from the current position of "from_fd" on, using the
+// fastest way available: copy_file_range() shares or copies the data in
+// the kernel, sendfile() at least avoids copying it to user space.
+static bool
+copyDescriptor(int from_fd, int to_fd)
+{
+    constexpr size_t CHUNK = 1 << 30;
+
+#ifdef __linux__
+    ssize_t cnt;
+
+#ifdef SYS_copy_file_range
+    while ((cnt = syscall(SYS_copy_file_range, from_fd, nullptr, to_fd, nullptr, CHUNK, 0)) > 0 ||
+           (cnt == -1 && errno == EINTR));
+
+    if (cnt == 0) return true;
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return false;
+#endif
+
+    while ((cnt = sendfile(to_fd, from_fd, nullptr, CHUNK)) > 0 || (cnt == -1 && errno == EINTR));
+
+    if (cnt == 0) return true;
+    if (errno != EINVAL && errno != ENOSYS) return false;
+#endif
+
+    constexpr size_t BUFFER_LENGTH = 1 << 20;
+    unique_ptr<char[]> buf(new char[BUFFER_LENGTH]);
+
+    for (;;) {
+        const ssize_t len = read(from_fd, buf.get(), BUFFER_LENGTH);
+
+        if (len == 0) return true;
+
+        if (len == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        for (ssize_t done = 0; done != len;) {
+            const ssize_t written = write(to_fd, buf.get() + done, static_cast<size_t>(len - done));
+
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            done += written;
+        }
+    }
+}
+
+// Durable copy of a regular file or symbolic link keeping mode, owner and
+// timestamps as far as permitted
+static bool
+copyEntryDurably(const string &source_path, const string &target_path, const struct stat &st, error_code &error)
+{
+    if (S_ISLNK(st.st_mode)) {
+        string link_target;
+
+        if (!FileSystem::readLink(source_path, link_target) ||
+            symlink(link_target.data(), target_path.data()) != 0) {
+            return setError(error, errno);
+        }
+
+        const struct timespec times[2] = {st.st_atim, st.st_mtim};
+        utimensat(AT_FDCWD, target_path.data(), static_cast<const struct timespec*>(times), AT_SYMLINK_NOFOLLOW);
+
+        error.clear();
+        return true;
+    }
+
+    if (!S_ISREG(st.st_mode)) return setError(error, EINVAL);
+
+    const int from_fd = open(source_path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (from_fd == -1) return setError(error, errno);
+
+    // Never replaces an existing file, like symlink() above
+    const int to_fd = open(target_path.data(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+
+    if (to_fd == -1) {
+        const int err = errno;
+        close(from_fd);
+        return setError(error, err);
+    }
+
+    const struct timespec times[2] = {st.st_atim, st.st_mtim};
+
+    bool ok = copyDescriptor(from_fd, to_fd);
+
+    // Ownership can only be kept with sufficient privileges
+    if (ok && fchown(to_fd, st.st_uid, st.st_gid) != 0 && errno != EPERM) ok = false;
+
+    ok = ok &&
+         fchmod(to_fd, st.st_mode & 07777) == 0 &&
+         futimens(to_fd, static_cast<const struct timespec*>(times)) == 0 &&
+         fsync(to_fd) == 0;
+
+    const int err = errno;
+
+    close(to_fd);
+    close(from_fd);
+
+    if (!ok) {
+        unlink(target_path.data());
+        return setError(error, err);
+    }
+
+    error.clear();
+    return true;
+}
+
+static bool
+removeTree(const string &path)
+{
+    if (FileSystem::isDir(path, false)) {
+        bool ok = true;
+
+        for (const auto &entry : DirectoryRange(path)) ok = removeTree(entry) && ok;
+
+        return ok && rmdir(path.data()) == 0;
+    }
+
+    return unlink(path.data()) == 0;
+}
+
+// Canonical paths of already resolved components, shared by all
+// getCanonicalPath() calls. Keys are paths with a canonical parent.
+static mutex canonical_cache_lock;
+static unordered_map<string, string> canonical_cache;
+
+// Bounds the cache for long running processes
+static constexpr size_t CANONICAL_CACHE_LIMIT = 1 << 16;
+
+static bool
+canonicalize(const string &path, string &resolved, int &links_left)
+{
+    resolved = DIR_SEP;
+
+    for (const auto &component : String::split(path, DIR_SEP)) {
+        if (component.empty() || component == ".") continue;
+
+        if (component == "..") {
+            resolved = resolved.substr(0, max<size_t>(1, resolved.rfind(DIR_SEP[0])));
+            continue;
+        }
+
+        string next = resolved.size() == 1 ? resolved + component : resolved + DIR_SEP + component;
+
+        {
+            lock_guard<mutex> guard(canonical_cache_lock);
+            const auto itr = canonical_cache.find(next);
+
+            if (itr != canonical_cache.end()) {
+                resolved = itr->second;
+                continue;
+            }
+        }
+
+        struct stat st {};
+
+        if (lstat(next.data(), &st) != 0) return false;
+
+        string canonical;
+
+        if (S_ISLNK(st.st_mode)) {
+            string target;
+
+            if (--links_left < 0 || !FileSystem::readLink(next, target)) return false;
+
+            if (!FileSystem::isAbsolutePath(target)) target = resolved + DIR_SEP + target;
+
+            if (!canonicalize(target, canonical, links_left)) return false;
+        } else {
+            canonical = next;
+        }
+
+        {
+            lock_guard<mutex> guard(canonical_cache_lock);
+
+            if (canonical_cache.size() >= CANONICAL_CACHE_LIMIT) canonical_cache.clear();
+
+            canonical_cache.emplace(move(next), canonical);
+        }
+
+        resolved = move(canonical);
+    }
+
+    return true;
+}
+#endif
+
+/*static*/ string
+FileSystem::
+getCleanPath(string path)
+{
+    if (!isAbsolutePath(path)) return path;
+
+    const bool target_is_directory = path.back() == DIR_SEP[0];
+
+#ifdef WIN
+    const string PARTITION = path.substr(0, 2);
+    path = path.substr(2);
+#endif
+
+    DataContainer<string> dirs = String::split(path, DIR_SEP);
+    path.clear();
+
+    for (auto itr = dirs.begin(); itr != dirs.end(); ++itr)
+        if (itr->empty() || *itr == ".")
+            dirs.erase(itr--);
+        else if (*itr == "..")
+            dirs.erase(itr--, itr--+1);
+
+#ifdef WIN
+    path = PARTITION;
+#endif
+
+    if (dirs.empty())
+        path += DIR_SEP;
+    else
+        for (const auto &dir : dirs)
+            path.append(DIR_SEP).append(dir);
+
+    if (target_is_directory)
+        path += DIR_SEP;
+
+    return path;
+}
+
+/*static*/ string
+FileSystem::
+getRelativePath(string path1, string path2)
+{
+    if (!isAbsolutePath(path1) || !isAbsolutePath(path2)) return string();
+
+#ifdef WIN
+    const string PARTITION = path1.substr(0, 2);
+
+    // Check, if both paths use the same partition and remove partition
+    // from the path temporarily
+    if (path1.front() == path2.front()) {
+        path1 = path1.substr(2, path1.length()-2);
+        path2 = path2.substr(2, path2.length()-2);
+    } else return string();
+#endif
+
+    const bool path2_is_file = path2.back() != '/';
+
+    DataContainer<string> dirs_path1(String::split(path1, DIR_SEP));
+    DataContainer<string> dirs_path2(String::split(path2, DIR_SEP));
+
+    for (auto itr = dirs_path1.rbegin()+1; itr != dirs_path1.rend()+1; ++itr)
+        if (itr.base()->empty()) dirs_path1.erase(itr.base());
+
+    for (auto itr = dirs_path2.rbegin()+1; itr != dirs_path2.rend()+1; ++itr)
+        if (itr.base()->empty()) dirs_path2.erase(itr.base());
+
+    string file_name;
+
+    if (isFile(path1)) dirs_path1.pop_back();
+
+    if (path2_is_file) {
+        file_name = dirs_path2.back();
+        dirs_path2.pop_back();
+    }
+
+    path1.clear();
+
+#ifdef WIN
+    path1 = PARTITION;
+#endif
+
+    if (dirs_path1.size() >= dirs_path2.size()) {
+        for (size_t i = 0; i != dirs_path1.size(); ++i) {
+            if (dirs_path2.size() > i && dirs_path1[i] == dirs_path2[i]) continue;
+            path1 += "..";
+            path1 += DIR_SEP;
+
+            for (; i != dirs_path1.size(); ++i) {
+                path1 += dirs_path2[i];
+                path1 += DIR_SEP;
+            }
+
+            break;
+        }
+    } else {
+        for (size_t i = 0; i != dirs_path2.size(); ++i) {
+            if (dirs_path1.size() > i && dirs_path1[i] == dirs_path2[i]) continue;
+            path1 += dirs_path2[i] + DIR_SEP;
+        }
+    }
+
+    if (path2_is_file) path1 += file_name;
+
+    return path1;
+}
+
+/*static*/ int64_t
+FileSystem::
+countEntries(const string &path, int64_t limit)
+{
+    int64_t cnt = 0;
+
+#ifdef __linux__
+    const int fd = open(path.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd == -1) return -1;
+
+    // Small directories fit into a single call
+    alignas(LinuxDirent64) char buf[2048];
+    long len = 0;
+
+    while ((limit < 0 || cnt < limit) &&
+           (len = syscall(SYS_getdents64, fd, static_cast<char*>(buf), sizeof(buf))) > 0) {
+        for (long pos = 0; pos < len && (limit < 0 || cnt < limit);) {
+            const auto * const entry = reinterpret_cast<const LinuxDirent64*>(static_cast<char*>(buf) + pos);
+            const char * const name = static_cast<const char*>(entry->d_name);
+
+            pos += entry->d_reclen;
+
+            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) ++cnt;
+        }
+    }
+
+    close(fd);
+
+    // A partial count would make a failing directory look empty
+    if (len == -1) return -1;
+#else
+    DIR * const dir = opendir(path.data());
+
+    if (dir == nullptr) return -1;
+
+    int err = 0;
+
+    while (limit < 0 || cnt < limit) {
+        // readdir() returns nullptr at the end and on errors, only the
+        // latter set errno
+        errno = 0;
+        const dirent * const entry = readdir(dir);
+
+        if (entry == nullptr) {
+            err = errno;
+            break;
+        }
+
+        const char * const name = static_cast<const char*>(entry->d_name);
+
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) ++cnt;
+    }
+
+    closedir(dir);
+
+    // A partial count would make a failing directory look empty
+    if (err != 0) return -1;
+#endif
+
+    return cnt;
+}
+
+/*static*/ DataContainer<string>
+FileSystem::
+getDirectoryContents(const string &path)
+{
+    DataContainer<string> entries;
+    dirent *entry;
+
+    const auto dir = opendir(path.data());
+
+    while (bool(entry = readdir(dir))) {
+        if (strcmp(static_cast<char*>(entry->d_name), ".") != 0 &&
+            strcmp(static_cast<char*>(entry->d_name), "..") != 0) {
+
+            entries.emplace_back(path + DIR_SEP + static_cast<char*>(entry->d_name));
+        }
+    }
+
+    closedir(dir);
+    delete entry;
+
+    return entries;
+}
+
+/*static*/ DataContainer<string>
+FileSystem::
+getDirectoryContents(const string &path, const DirectoryFilter &filter)
+{
+    DataContainer<string> entries;
+
+    const bool match_name = !filter.name_regex.empty();
+    regex name_regex;
+
+    // An invalid expression matches nothing
+    try {
+        if (match_name) name_regex.assign(filter.name_regex);
+    } catch (const regex_error&) {
+        return entries;
+    }
+
+    const bool need_stat = filter.min_size != -1 || filter.max_size != -1 ||
+                           filter.min_mtime != 0 || filter.max_mtime != 0;
+
+    DIR * const dir = opendir(path.data());
+
+    if (dir == nullptr) return entries;
+
+    dirent *entry;
+
+    while (bool(entry = readdir(dir))) {
+        const char * const name = static_cast<char*>(entry->d_name);
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        if (!filter.extensions.empty()) {
+            const char * const extension = strrchr(name, '.');
+
+            if (extension == nullptr ||
+                find(filter.extensions.begin(), filter.extensions.end(), extension) == filter.extensions.end()) {
+                continue;
+            }
+        }
+
+        if (match_name && !regex_match(name, name_regex)) continue;
+
+        bool type_known = filter.type == DirectoryFilter::TYPE_ANY;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (!type_known && entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+            if ((filter.type == DirectoryFilter::TYPE_FILE) != (entry->d_type == DT_REG) ||
+                (filter.type == DirectoryFilter::TYPE_DIRECTORY) != (entry->d_type == DT_DIR)) {
+                continue;
+            }
+
+            type_known = true;
+        }
+#endif
+
+        string entry_path = path + DIR_SEP + name;
+
+        if (need_stat || !type_known) {
+            struct stat st {};
+
+#ifdef WIN
+            if (stat(entry_path.data(), &st) != 0) continue;
+#else
+            if (fstatat(dirfd(dir), name, &st, 0) != 0) continue;
+#endif
+
+            if ((filter.type == DirectoryFilter::TYPE_FILE && !S_ISREG(st.st_mode)) ||
+                (filter.type == DirectoryFilter::TYPE_DIRECTORY && !S_ISDIR(st.st_mode)) ||
+                (filter.min_size != -1 && st.st_size < filter.min_size) ||
+                (filter.max_size != -1 && st.st_size > filter.max_size) ||
+                (filter.min_mtime != 0 && st.st_mtime < filter.min_mtime) ||
+                (filter.max_mtime != 0 && st.st_mtime > filter.max_mtime)) {
+                continue;
+            }
+        }
+
+        entries.push_back(move(entry_path));
+    }
+
+    closedir(dir);
+
+    return entries;
+}
+
+/*static*/ DataContainer<string>
+FileSystem::
+getDirectoryPage(const string &path, string &cursor, size_t page_size, SortOrder order)
+{
+    DataContainer<string> entries;
+
+    if (page_size == 0) return entries;
+
+    DIR * const dir = opendir(path.data());
+
+    if (dir == nullptr) return entries;
+
+    dirent *entry;
+
+    if (order == SORT_NONE) {
+        // The cursor is the directory stream position after the last entry
+        if (!cursor.empty()) seekdir(dir, strtol(cursor.data(), nullptr, 10));
+
+        while (entries.size() != page_size && bool(entry = readdir(dir))) {
+            const char * const name = static_cast<char*>(entry->d_name);
+
+            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                entries.emplace_back(path + DIR_SEP + name);
+            }
+        }
+
+        cursor = to_string(telldir(dir));
+        closedir(dir);
+
+        return entries;
+    }
+
+    // The cursor is the last name returned. Each page is one pass over the
+    // directory, keeping only the "page_size" smallest names after it.
+    typedef bool (*Less)(const string&, const string&);
+
+    const Less less = order == SORT_NATURAL ? naturalLess : [](const string &a, const string &b) { return a < b; };
+    priority_queue<string, DataContainer<string>, Less> page(less);
+
+    while (bool(entry = readdir(dir))) {
+        const char * const name = static_cast<char*>(entry->d_name);
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        string entry_name(name);
+
+        if (!cursor.empty() && !less(cursor, entry_name)) continue;
+
+        if (page.size() != page_size) {
+            page.push(move(entry_name));
+        } else if (less(entry_name, page.top())) {
+            page.pop();
+            page.push(move(entry_name));
+        }
+    }
+
+    closedir(dir);
+
+    entries.resize(page.size());
+
+    for (auto itr = entries.rbegin(); itr != entries.rend(); ++itr) {
+        *itr = path + DIR_SEP + page.top();
+        page.pop();
+    }
+
+    if (!entries.empty()) cursor = getBaseName(entries.back());
+
+    return entries;
+}
+
+/*static*/ bool
+FileSystem::
+matchesPattern(const string &pattern, const string &name)
+{
+    DataContainer<string> patterns;
+
+    expandBraces(pattern, patterns);
+
+    for (const auto &expanded : patterns) {
+        if (matchGlobSegment(expanded.data(), name.data())) return true;
+    }
+
+    return false;
+}
+
+/*static*/ DataContainer<string>
+FileSystem::
+glob(const string &pattern)
+{
+    DataContainer<string> matches;
+    DataContainer<string> patterns;
+
+    expandBraces(pattern, patterns);
+
+    for (const auto &expanded : patterns) {
+        DataContainer<GlobSegment> segments;
+        string base;
+
+#ifdef WIN
+        if (isAbsolutePath(expanded)) base = expanded.substr(0, 2) + DIR_SEP;
+        const string relative = base.empty() ? expanded : expanded.substr(2);
+#else
+        if (isAbsolutePath(expanded)) base = DIR_SEP;
+        const string &relative = expanded;
+#endif
+
+        for (const auto &component : String::split(relative, DIR_SEP)) {
+            if (component.empty()) continue;
+
+            // Consecutive "**" are equivalent to a single one
+            if (component == "**" && !segments.empty() && segments.back().recursive) continue;
+
+            segments.push_back(compileGlobSegment(component));
+        }
+
+        if (!segments.empty()) globWalk(base, segments, 0, matches);
+    }
+
+    sort(matches.begin(), matches.end());
+    matches.erase(unique(matches.begin(), matches.end()), matches.end());
+
+    return matches;
+}
+
+/*static*/ bool
+FileSystem::
+copyFile(const string &input_path, const string &output_path)
+{
+    error_code error;
+    return copyFile(input_path, output_path, error);
+}
+
+/*static*/ bool
+FileSystem::
+copyFile(const string &input_path, const string &output_path, error_code &error)
+{
+    FILE * const from_fp = fopen(input_path.data(), "re");
+
+    if (from_fp == nullptr) return setError(error, errno);
+
+    FILE * const to_fp = fopen(output_path.data(), "we");
+
+    if (to_fp == nullptr) {
+        const int err = errno;
+        fclose(from_fp);
+        return setError(error, err);
+    }
+
+    constexpr size_t BUFFER_LENGTH = 4096;
+    char buf[BUFFER_LENGTH];
+    size_t cnt = 0;
+    int err = 0;
+
+    while (bool(cnt = fread(static_cast<char*>(buf), 1, BUFFER_LENGTH, from_fp))) {
+        if (fwrite(static_cast<char*>(buf), 1, cnt, to_fp) != cnt) {
+            err = errno;
+            break;
+        }
+    }
+
+    if (err == 0 && ferror(from_fp)) err = errno;
+    if (fclose(to_fp) != 0 && err == 0) err = errno;
+
+    fclose(from_fp);
+
+    if (err != 0) return setError(error, err);
+
+    error.clear();
+    return true;
+}
+
+#ifndef WIN
+/*static*/ bool
+FileSystem::
+copyFileResumable(const string &source_path, const string &target_path, size_t block_size)
+{
+    // Blocks copied between two checkpoints
+    constexpr size_t CHECKPOINT_INTERVAL = 8;
+
+    if (block_size == 0) return false;
+
+    const string part_path = target_path + ".part";
+    const string checkpoint_path = part_path + ".checkpoint";
+
+    const int from_fd = open(source_path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (from_fd == -1) return false;
+
+    struct stat from_st {};
+
+    if (fstat(from_fd, &from_st) != 0) {
+        close(from_fd);
+        return false;
+    }
+
+    // The source mode is applied on completion, a read-only mode here would
+    // keep the partial file from being reopened after an interruption
+    const int to_fd = open(part_path.data(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    if (to_fd == -1) {
+        close(from_fd);
+        return false;
+    }
+
+    unique_ptr<char[]> buf(new char[block_size]);
+    CopyCheckpoint cp {};
+    struct stat to_st {};
+
+    // Resume only, if the source is unchanged and the last committed block
+    // still matches in both files
+    bool resume = readCheckpoint(checkpoint_path, cp) &&
+                  isSameSource(cp, from_st) &&
+                  cp.offset > 0 && cp.offset <= from_st.st_size &&
+                  cp.tail_length != 0 && cp.tail_length <= block_size &&
+                  cp.tail_length <= static_cast<uint64_t>(cp.offset) &&
+                  fstat(to_fd, &to_st) == 0 && to_st.st_size >= cp.offset;
+
+    if (resume) {
+        const size_t tail_length = static_cast<size_t>(cp.tail_length);
+        const off_t tail_offset = cp.offset - static_cast<off_t>(tail_length);
+
+        resume = preadFull(to_fd, buf.get(), tail_length, tail_offset) == static_cast<ssize_t>(tail_length) &&
+                 adler32(1, buf.get(), tail_length) == cp.tail_checksum &&
+                 preadFull(from_fd, buf.get(), tail_length, tail_offset) == static_cast<ssize_t>(tail_length) &&
+                 adler32(1, buf.get(), tail_length) == cp.tail_checksum;
+    }
+
+    if (!resume) {
+        cp = CopyCheckpoint {from_st.st_size, static_cast<int64_t>(from_st.st_mtim.tv_sec),
+                             static_cast<int64_t>(from_st.st_mtim.tv_nsec), static_cast<uint64_t>(from_st.st_ino),
+                             0, 1, 1, 0};
+    }
+
+    // Drop everything written after the last checkpoint
+    bool ok = ftruncate(to_fd, cp.offset) == 0;
+    size_t blocks = 0;
+
+    while (ok && cp.offset < from_st.st_size) {
+        const ssize_t cnt = preadFull(from_fd, buf.get(), block_size, cp.offset);
+
+        if (cnt <= 0) {
+            ok = false;
+            break;
+        }
+
+        ok = pwriteFull(to_fd, buf.get(), static_cast<size_t>(cnt), cp.offset);
+
+        cp.checksum = adler32(cp.checksum, buf.get(), static_cast<size_t>(cnt));
+        cp.tail_checksum = adler32(1, buf.get(), static_cast<size_t>(cnt));
+        cp.tail_length = static_cast<uint64_t>(cnt);
+        cp.offset += cnt;
+
+        if (ok && ++blocks % CHECKPOINT_INTERVAL == 0) {
+            ok = fdatasync(to_fd) == 0 && writeCheckpoint(checkpoint_path, cp);
+        }
+    }
+
+    ok = ok && fchmod(to_fd, from_st.st_mode & 0777) == 0 && fsync(to_fd) == 0;
+
+    close(to_fd);
+    close(from_fd);
+
+    // Keep the partial file and the last checkpoint for the next attempt
+    if (!ok || !rename(part_path, target_path)) return false;
+
+    deleteFile(checkpoint_path);
+
+    return true;
+}
+
+/*static*/ bool
+FileSystem::
+updateFile(const string &source_path, const string &target_path, size_t block_size)
+{
+    if (block_size == 0) return false;
+
+    const int from_fd = open(source_path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (from_fd == -1) return false;
+
+    struct stat from_st {};
+
+    if (fstat(from_fd, &from_st) != 0) {
+        close(from_fd);
+        return false;
+    }
+
+    const int to_fd = open(target_path.data(), O_RDWR | O_CREAT | O_CLOEXEC, from_st.st_mode & 0777);
+
+    if (to_fd == -1) {
+        close(from_fd);
+        return false;
+    }
+
+    // Blocks beyond the old end of the target read back as zeros and are
+    // only written, if the source block is not all zeros as well
+    if (ftruncate(to_fd, from_st.st_size) != 0) {
+        close(to_fd);
+        close(from_fd);
+        return false;
+    }
+
+    // Blocks compared per task, so the buffers are reused in between
+    constexpr int64_t TASK_BLOCKS = 16;
+
+    const int64_t size = from_st.st_size;
+    const int64_t blocks = (size + static_cast<int64_t>(block_size) - 1) / static_cast<int64_t>(block_size);
+    const int64_t tasks = (blocks + TASK_BLOCKS - 1) / TASK_BLOCKS;
+
+    atomic<bool> ok(true);
+
+    // Compare the blocks of a task and rewrite only the ones that differ
+    runParallel(static_cast<size_t>(tasks), 0, [&](size_t task) {
+        unique_ptr<char[]> from_buf(new char[block_size]);
+        unique_ptr<char[]> to_buf(new char[block_size]);
+
+        const int64_t first = static_cast<int64_t>(task) * TASK_BLOCKS;
+        const int64_t last = min(first + TASK_BLOCKS, blocks);
+
+        for (int64_t block = first; block != last && ok; ++block) {
+            const off_t offset = block * static_cast<off_t>(block_size);
+            const size_t len = static_cast<size_t>(min<int64_t>(static_cast<int64_t>(block_size), size - offset));
+
+            if (preadFull(from_fd, from_buf.get(), len, offset) != static_cast<ssize_t>(len) ||
+                preadFull(to_fd, to_buf.get(), len, offset) != static_cast<ssize_t>(len)) {
+                ok = false;
+                break;
+            }
+
+            if (memcmp(from_buf.get(), to_buf.get(), len) != 0 &&
+                !pwriteFull(to_fd, from_buf.get(), len, offset)) {
+                ok = false;
+            }
+        }
+    }, 1);
+
+    close(to_fd);
+    close(from_fd);
+
+    return ok;
+}
+
+#endif
+
+#ifndef WIN
+/*static*/ bool
+FileSystem::
+copyTree(const string &source_path, const string &target_path)
+{
+    InodeSet inodes;
+    return copyTreeEntry(source_path, target_path, inodes);
+}
+
+/*static*/ int64_t
+FileSystem::
+getDiskUsage(const string &path, bool follow_symlinks)
+{
+    if (!exists(path)) return -1;
+
+    InodeSet inodes, directories;
+    return diskUsage(path, follow_symlinks, inodes, directories);
+}
+#endif
+
+#ifndef WIN
+/*static*/ bool
+FileSystem::
+readLink(const string &path, string &target)
+{
+    struct stat st {};
+
+    if (lstat(path.data(), &st) != 0 || !S_ISLNK(st.st_mode)) return false;
+
+    // st_size is 0 for some pseudo file systems, grow the buffer until the
+    // whole target fits
+    target.resize(max<size_t>(static_cast<size_t>(st.st_size), 64) + 1);
+
+    for (;;) {
+        const ssize_t len = readlink(path.data(), &target[0], target.size());
+
+        if (len < 0) return false;
+
+        if (static_cast<size_t>(len) < target.size()) {
+            target.resize(static_cast<size_t>(len));
+            return true;
+        }
+
+        target.resize(target.size() * 2);
+    }
+}
+
+/*static*/ bool
+FileSystem::
+syncDirectory(const string &path)
+{
+    const int fd = open(path.empty() ? "." : path.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd == -1) return false;
+
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+
+    return ok;
+}
+
+/*static*/ string
+FileSystem::
+getCanonicalPath(const string &path)
+{
+    string absolute_path = path;
+
+    if (!isAbsolutePath(path)) {
+        char cwd[PATH_MAX];
+
+        if (getcwd(static_cast<char*>(cwd), sizeof(cwd)) == nullptr) return string();
+
+        absolute_path = string(static_cast<char*>(cwd)) + DIR_SEP + path;
+    }
+
+    // Same limit as the kernel uses for nested symbolic links
+    int links_left = 40;
+    string resolved;
+
+    if (!canonicalize(absolute_path, resolved, links_left)) return string();
+
+    return resolved;
+}
+
+/*static*/ void
+FileSystem::
+clearCanonicalPathCache()
+{
+    lock_guard<mutex> guard(canonical_cache_lock);
+    canonical_cache.clear();
+}
+#endif
+
+/*static*/ bool
+FileSystem::
+createPath(string path, string &fail_path)
+{
+    error_code error;
+    return createPath(path, fail_path, error);
+}
 
-/*static*/ string
+/*static*/ bool
 FileSystem::
-getCleanPath(string path)
+createPath(string path, string &fail_path, error_code &error)
 {
-    if (!isAbsolutePath(path)) return path;
-
-    const bool target_is_directory = path.back() == DIR_SEP[0];
+    if (!isAbsolutePath(path)) return setError(error, EINVAL);
 
 #ifdef WIN
-    const string PARTITION = path.substr(0, 2);
+#define PARTITION partition +
+    const string partition = path.substr(0, 2);
     path = path.substr(2);
+
+    if (path.empty()) path = DIR_SEP;
+#else
+#define PARTITION
 #endif
 
-    DataContainer<string> dirs = String::split(path, DIR_SEP);
+    DataContainer<string> directories = String::split(path, DIR_SEP);
+
     path.clear();
 
-    for (auto itr = dirs.begin(); itr != dirs.end(); ++itr)
-        if (itr->empty() || *itr == ".")
-            dirs.erase(itr--);
-        else if (*itr == "..")
-            dirs.erase(itr--, itr--+1);
+    if (directories.empty())
+        path.append(DIR_SEP);
+    else {
+        for (auto itr = directories.begin(); itr != directories.end(); ++itr) {
+            if (itr->empty()) {
+                directories.erase(itr--);
+                continue;
+            }
 
-#ifdef WIN
-    path = PARTITION;
+            path.append(DIR_SEP + *itr);
+
+            if (exists(PARTITION path)) {
+                if (!isDir(PARTITION path)) {
+                    fail_path = PARTITION path;
+                    return setError(error, ENOTDIR);
+                }
+
+                continue;
+            }
+
+            if (!createDirectory(PARTITION path)) {
+                fail_path = PARTITION path;
+                return setError(error, errno);
+            }
+        }
+    }
+
+    error.clear();
+    return true;
+
+#undef PARTITION
+}
+
+/*static*/ bool
+FileSystem::
+rename(const string &current_path, const string &new_path, RenameMode mode, error_code &error)
+{
+    if (mode == RENAME_OVERWRITE) return rename(current_path, new_path, error);
+
+#if defined(__linux__) && defined(SYS_renameat2)
+    // Values of RENAME_NOREPLACE and RENAME_EXCHANGE
+    const unsigned int flags = mode == RENAME_KEEP_EXISTING ? 1 : 2;
+
+    if (syscall(SYS_renameat2, AT_FDCWD, current_path.data(), AT_FDCWD, new_path.data(), flags) == 0) {
+        error.clear();
+        return true;
+    }
+
+    // Only emulate, if the kernel or the file system lacks support
+    if (errno != ENOSYS && errno != EINVAL) return setError(error, errno);
 #endif
 
-    if (dirs.empty())
-        path += DIR_SEP;
-    else
-        for (const auto &dir : dirs)
-            path.append(DIR_SEP).append(dir);
+    if (mode == RENAME_KEEP_EXISTING) {
+        // link() never replaces, but does not work for directories, for
+        // which the check is not atomic
+        if (link(current_path.data(), new_path.data()) == 0) {
+            if (deleteFile(current_path, error)) return true;
 
-    if (target_is_directory)
-        path += DIR_SEP;
+            deleteFile(new_path);
+            return false;
+        }
 
-    return path;
+        if (errno != EPERM && errno != EISDIR) return setError(error, errno);
+        if (exists(new_path)) return setError(error, EEXIST);
+
+        return rename(current_path, new_path, error);
+    }
+
+    // Not atomic: both paths are briefly missing one after another. The
+    // temporary name must not replace anything.
+    const string tmp_prefix = new_path + ".swap" + to_string(getpid()) + "_";
+    string tmp_path;
+
+    for (unsigned int attempt = 0;; ++attempt) {
+        tmp_path = tmp_prefix + to_string(attempt);
+
+        if (rename(new_path, tmp_path, RENAME_KEEP_EXISTING, error)) break;
+        if (error != errc::file_exists) return false;
+    }
+
+    if (!rename(current_path, new_path, error)) {
+        rename(tmp_path, new_path);
+        return false;
+    }
+
+    if (!rename(tmp_path, current_path, error)) {
+        rename(new_path, current_path);
+        rename(tmp_path, new_path);
+        return false;
+    }
+
+    return true;
 }
 
-/*static*/ string
+#ifndef WIN
+/*static*/ bool
 FileSystem::
-getRelativePath(string path1, string path2)
+moveFile(const string &source_path, const string &target_path, error_code &error)
 {
-    if (!isAbsolutePath(path1) || !isAbsolutePath(path2)) return string();
+    if (rename(source_path, target_path, error) || error != errc::cross_device_link) return !error;
 
-#ifdef WIN
-    const string PARTITION = path1.substr(0, 2);
+    struct stat st {};
 
-    // Check, if both paths use the same partition and remove partition
-    // from the path temporarily
-    if (path1.front() == path2.front()) {
-        path1 = path1.substr(2, path1.length()-2);
-        path2 = path2.substr(2, path2.length()-2);
-    } else return string();
+    if (lstat(source_path.data(), &st) != 0) return setError(error, errno);
+
+    // Copy under an unused temporary name, so the target never appears
+    // incomplete and no other file gets replaced
+    const string tmp_prefix = target_path + ".moving" + to_string(getpid()) + "_";
+    string tmp_path;
+
+    for (unsigned int attempt = 0;; ++attempt) {
+        tmp_path = tmp_prefix + to_string(attempt);
+
+        if (copyEntryDurably(source_path, tmp_path, st, error)) break;
+        if (error != errc::file_exists) return false;
+    }
+
+    if (!rename(tmp_path, target_path, error)) {
+        unlink(tmp_path.data());
+        return false;
+    }
+
+    syncDirectory(getParentPath(target_path));
+
+    return deleteFile(source_path, error);
+}
+
+/*static*/ bool
+FileSystem::
+moveTree(const string &source_path, const string &target_path, error_code &error, unsigned int threads)
+{
+    if (rename(source_path, target_path, error) || error != errc::cross_device_link) return !error;
+
+    struct stat root_st {};
+
+    if (lstat(source_path.data(), &root_st) != 0) return setError(error, errno);
+
+    if (!S_ISDIR(root_st.st_mode)) return moveFile(source_path, target_path, error);
+
+    // Create the directories first and collect the files, hard links are
+    // recreated after the file they refer to has been copied
+    struct Entry
+    {
+        string source, target;
+        struct stat st;
+    };
+
+    DataContainer<Entry> directories {{source_path, target_path, root_st}};
+    DataContainer<Entry> files;
+    DataContainer<pair<string, string>> links;
+    InodeSet inodes;
+
+    // As rename() does, an existing target is only replaced, if it is an
+    // empty directory
+    const bool created = mkdir(target_path.data(), 0700) == 0;
+    struct stat target_st {};
+
+    if (!created) {
+        if (errno != EEXIST || lstat(target_path.data(), &target_st) != 0) return setError(error, errno);
+        if (!S_ISDIR(target_st.st_mode)) return setError(error, ENOTDIR);
+        if (countEntries(target_path, 1) != 0) return setError(error, ENOTEMPTY);
+    }
+
+    // On failure the partial copy is removed again, the source is untouched
+    const auto fail = [&](int err) {
+        for (const auto &dir : directories) chmod(dir.target.data(), 0700);
+        for (const auto &entry : DirectoryRange(target_path)) removeTree(entry);
+
+        if (created) {
+            rmdir(target_path.data());
+        } else {
+            chmod(target_path.data(), target_st.st_mode & 07777);
+        }
+
+        return setError(error, err);
+    };
+
+    for (size_t i = 0; i != directories.size(); ++i) {
+        // Copy, as adding subdirectories may reallocate
+        const Entry dir = directories[i];
+
+        if (i != 0 && mkdir(dir.target.data(), 0700) != 0) return fail(errno);
+
+        for (const auto &entry : DirectoryRange(dir.source)) {
+            Entry child {entry, dir.target + DIR_SEP + getBaseName(entry), {}};
+
+            if (lstat(entry.data(), &child.st) != 0) return fail(errno);
+
+            string first_target;
+
+            if (S_ISDIR(child.st.st_mode)) {
+                directories.push_back(move(child));
+            } else if (child.st.st_nlink > 1 && !inodes.insert(child.st, child.target, &first_target)) {
+                links.emplace_back(move(first_target), move(child.target));
+            } else {
+                files.push_back(move(child));
+            }
+        }
+    }
+
+    atomic<int> err(0);
+
+    runParallel(files.size(), threads, [&](size_t i) {
+        error_code file_error;
+
+        if (err == 0 && !copyEntryDurably(files[i].source, files[i].target, files[i].st, file_error)) {
+            err = file_error.value();
+        }
+    });
+
+    if (err != 0) return fail(err);
+
+    for (const auto &link_paths : links) {
+        if (link(link_paths.first.data(), link_paths.second.data()) != 0) return fail(errno);
+    }
+
+    // Directory metadata last, as creating entries changes the timestamps
+    for (auto itr = directories.rbegin(); itr != directories.rend(); ++itr) {
+        const struct timespec times[2] = {itr->st.st_atim, itr->st.st_mtim};
+
+        if (lchown(itr->target.data(), itr->st.st_uid, itr->st.st_gid) != 0 && errno != EPERM) return fail(errno);
+
+        if (chmod(itr->target.data(), itr->st.st_mode & 07777) != 0 ||
+            utimensat(AT_FDCWD, itr->target.data(), static_cast<const struct timespec*>(times), 0) != 0 ||
+            !syncDirectory(itr->target)) {
+            return fail(errno);
+        }
+    }
+
+    syncDirectory(getParentPath(target_path));
+
+    // The source is only removed once everything is on disk
+    if (!removeTree(source_path)) return setError(error, errno);
+
+    error.clear();
+    return true;
+}
 #endif
 
-    const bool path2_is_file = path2.back() != '/';
+/*static*/ bool
+FileSystem::
+readFile(const string &path, string &content)
+{
+    error_code error;
+    return readFile(path, content, error);
+}
 
-    DataContainer<string> dirs_path1(String::split(path1, DIR_SEP));
-    DataContainer<string> dirs_path2(String::split(path2, DIR_SEP));
+/*static*/ bool
+FileSystem::
+readFile(const string &path, string &content, error_code &error, int64_t max_size)
+{
+    content.clear();
 
-    for (auto itr = dirs_path1.rbegin()+1; itr != dirs_path1.rend()+1; ++itr)
-        if (itr.base()->empty()) dirs_path1.erase(itr.base());
+    FILE * const fp = fopen(path.data(), "re");
 
-    for (auto itr = dirs_path2.rbegin()+1; itr != dirs_path2.rend()+1; ++itr)
-        if (itr.base()->empty()) dirs_path2.erase(itr.base());
+    if (fp == nullptr) return setError(error, errno);
 
-    string file_name;
+    // The size is only a hint, files in /proc report 0 and text mode may
+    // shrink the content. One extra byte catches a missing final newline
+    // without reallocating.
+    struct stat st {};
+    const int64_t size_hint = fstat(fileno(fp), &st) == 0 ? static_cast<int64_t>(st.st_size) : 0;
 
-    if (isFile(path1)) dirs_path1.pop_back();
+    if ((max_size >= 0 && size_hint > max_size) ||
+        static_cast<uint64_t>(size_hint) >= content.max_size()) {
+        fclose(fp);
+        return setError(error, EFBIG);
+    }
 
-    if (path2_is_file) {
-        file_name = dirs_path2.back();
-        dirs_path2.pop_back();
+    content.resize(static_cast<size_t>(size_hint) + 1);
+
+    size_t len = 0;
+
+    for (;;) {
+        if (len == content.size()) {
+            if (max_size >= 0 && static_cast<int64_t>(len) > max_size) {
+                content.clear();
+                fclose(fp);
+                return setError(error, EFBIG);
+            }
+
+            content.resize(len * 2);
+        }
+
+        const size_t cnt = fread(&content[len], 1, content.size() - len, fp);
+
+        if (cnt == 0) break;
+
+        len += cnt;
     }
 
-    path1.clear();
+    const bool failed = ferror(fp) != 0;
+    const int err = errno;
 
-#ifdef WIN
-    path1 = PARTITION;
+    fclose(fp);
+
+    if (failed || (max_size >= 0 && static_cast<int64_t>(len) > max_size)) {
+        content.clear();
+        return setError(error, failed ? err : EFBIG);
+    }
+
+    content.resize(len);
+
+    // Same result as reading line by line: every line ends with a newline
+    if (!content.empty() && content.back() != '\n') content += '\n';
+
+    error.clear();
+    return true;
+}
+
+/*static*/ bool
+FileSystem::
+readFile(const string &path, FileContent &content, error_code &error, int64_t map_threshold)
+{
+    content.clear();
+
+#ifndef WIN
+    const int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) return setError(error, errno);
+
+    const bool res = readFile(fd, content, error, map_threshold);
+
+    close(fd);
+
+    return res;
+#else
+    (void)map_threshold;
+
+    FILE * const fp = fopen(path.data(), "rb");
+
+    if (fp == nullptr) return setError(error, errno);
+
+    char buf[4096];
+    size_t cnt;
+
+    while (bool(cnt = fread(static_cast<char*>(buf), 1, sizeof(buf), fp))) {
+        content.buffer.append(static_cast<char*>(buf), cnt);
+    }
+
+    const bool failed = ferror(fp) != 0;
+
+    fclose(fp);
+
+    if (failed) {
+        content.clear();
+        return setError(error, EIO);
+    }
+
+    error.clear();
+    return true;
 #endif
+}
 
-    if (dirs_path1.size() >= dirs_path2.size()) {
-        for (size_t i = 0; i != dirs_path1.size(); ++i) {
-            if (dirs_path2.size() > i && dirs_path1[i] == dirs_path2[i]) continue;
-            path1 += "..";
-            path1 += DIR_SEP;
+#ifndef WIN
+/*static*/ bool
+FileSystem::
+readFile(int fd, FileContent &content, error_code &error, int64_t map_threshold)
+{
+    content.clear();
+
+    struct stat st {};
+
+    if (fstat(fd, &st) != 0) return setError(error, errno);
+
+    if (S_ISREG(st.st_mode) && map_threshold >= 0 && st.st_size > map_threshold) {
+        if (static_cast<uint64_t>(st.st_size) > SIZE_MAX) return setError(error, EFBIG);
+
+        void * const mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED) return setError(error, errno);
+
+        madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+        content.mapping = mapping;
+        content.mapping_size = static_cast<size_t>(st.st_size);
+
+        error.clear();
+        return true;
+    }
+
+    content.buffer.resize(S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0);
+
+    size_t len = 0;
+
+    for (;;) {
+        if (len == content.buffer.size()) content.buffer.resize(max<size_t>(len * 2, 4096));
+
+        const ssize_t cnt = read(fd, &content.buffer[len], content.buffer.size() - len);
+
+        if (cnt == -1 && errno == EINTR) continue;
+
+        if (cnt == -1) {
+            const int err = errno;
+            content.clear();
+            return setError(error, err);
+        }
+
+        if (cnt == 0) break;
+
+        len += static_cast<size_t>(cnt);
+    }
+
+    content.buffer.resize(len);
+
+    error.clear();
+    return true;
+}
+
+/*static*/ DataContainer<string>
+FileSystem::
+tail(const string &path, size_t lines)
+{
+    DataContainer<string> result;
+    ReverseLineReader reader(path);
+    string line;
+
+    while (result.size() != lines && reader.next(line)) result.push_back(move(line));
+
+    reverse(result.begin(), result.end());
+
+    return result;
+}
+
+/*static*/ int64_t
+FileSystem::
+readFileInto(const string &path, char *buffer, size_t capacity, error_code &error)
+{
+    const int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        setError(error, errno);
+        return -1;
+    }
+
+    struct stat st {};
+
+    if (fstat(fd, &st) != 0 || (S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) > capacity)) {
+        const int err = errno;
+        close(fd);
+        setError(error, S_ISREG(st.st_mode) ? EFBIG : err);
+        return -1;
+    }
 
-            for (; i != dirs_path1.size(); ++i) {
-                path1 += dirs_path2[i];
-                path1 += DIR_SEP;
-            }
+    // The size is unknown for pipes and files in /proc, which report 0,
+    // and a regular file may grow in the meantime. A full buffer is only
+    // a success if nothing follows.
+    ssize_t len = readFull(fd, buffer, capacity);
+    int err = errno;
 
-            break;
-        }
-    } else {
-        for (size_t i = 0; i != dirs_path2.size(); ++i) {
-            if (dirs_path1.size() > i && dirs_path1[i] == dirs_path2[i]) continue;
-            path1 += dirs_path2[i] + DIR_SEP;
+    if (len != -1 && static_cast<size_t>(len) == capacity) {
+        char extra;
+        const ssize_t cnt = readFull(fd, &extra, 1);
+
+        if (cnt != 0) {
+            err = cnt == 1 ? EFBIG : errno;
+            len = -1;
         }
     }
 
-    if (path2_is_file) path1 += file_name;
+    close(fd);
 
-    return path1;
+    if (len == -1) {
+        setError(error, err);
+        return -1;
+    }
+
+    error.clear();
+    return len;
 }
 
-/*static*/ DataContainer<string>
+/*static*/ bool
 FileSystem::
-getDirectoryContents(const string &path)
+readFileInto(const string &path, DataContainer<char> &buffer, error_code &error)
 {
-    DataContainer<string> entries;
-    dirent *entry;
+    const int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
 
-    const auto dir = opendir(path.data());
+    if (fd == -1) return setError(error, errno);
 
-    while (bool(entry = readdir(dir))) {
-        if (strcmp(static_cast<char*>(entry->d_name), ".") != 0 &&
-            strcmp(static_cast<char*>(entry->d_name), "..") != 0) {
+    struct stat st {};
 
-            entries.emplace_back(path + DIR_SEP + static_cast<char*>(entry->d_name));
+    if (fstat(fd, &st) != 0) {
+        const int err = errno;
+        close(fd);
+        return setError(error, err);
+    }
+
+    // The buffer keeps its capacity, but growing it zero-fills the added
+    // bytes, which a vector does not allow to avoid. Callers reading files
+    // of varying size without that cost use the char* overload. Files in
+    // /proc report a size of 0, their size is unknown as for pipes.
+    const bool size_known = S_ISREG(st.st_mode) && st.st_size != 0;
+    size_t len = 0;
+
+    buffer.resize(size_known ? static_cast<size_t>(st.st_size) : max<size_t>(buffer.size(), 4096));
+
+    for (;;) {
+        const ssize_t cnt = readFull(fd, buffer.data() + len, buffer.size() - len);
+
+        if (cnt == -1) {
+            const int err = errno;
+            close(fd);
+            return setError(error, err);
         }
+
+        len += static_cast<size_t>(cnt);
+
+        if (len != buffer.size() || size_known) break;
+
+        buffer.resize(len * 2);
     }
 
-    closedir(dir);
-    delete entry;
+    close(fd);
 
-    return entries;
+    buffer.resize(len);
+
+    error.clear();
+    return true;
 }
 
 /*static*/ bool
 FileSystem::
-copyFile(const string &input_path, const string &output_path)
+readFiles(const DataContainer<string> &paths, FileArena &arena, unsigned int threads)
 {
-    FILE * const from_fp = fopen(input_path.data(), "re");
+    arena.buffer.reset();
+    arena.entries.assign(paths.size(), FileArena::Entry {0, 0, 0});
+
+    // Sizes first, so the arena is allocated once. The files are not kept
+    // open in between, thousands of them would exhaust the descriptors.
+    runParallel(paths.size(), threads, [&](size_t i) {
+        struct stat st {};
+
+        if (stat(paths[i].data(), &st) != 0) {
+            arena.entries[i].error = errno;
+        } else if (!S_ISREG(st.st_mode)) {
+            arena.entries[i].error = EINVAL;
+        } else {
+            arena.entries[i].length = static_cast<size_t>(st.st_size);
+        }
+    });
+
+    size_t total = 0;
+
+    for (auto &entry : arena.entries) {
+        entry.offset = total;
+        total += entry.length;
+    }
+
+    arena.buffer.reset(new char[max<size_t>(total, 1)]);
 
-    if (from_fp != nullptr) {
-        constexpr size_t BUFFER_LENGTH = 4096;
-        char buf[BUFFER_LENGTH];
-        size_t cnt = 0;
+    atomic<bool> ok(true);
 
-        FILE * const to_fp = fopen(output_path.data(), "we");
+    runParallel(paths.size(), threads, [&](size_t i) {
+        FileArena::Entry &entry = arena.entries[i];
 
-        while (bool(cnt = fread(static_cast<char*>(buf), 1, BUFFER_LENGTH, from_fp))) {
-            fwrite(static_cast<char*>(buf), 1, cnt, to_fp);
+        if (entry.error != 0) {
+            ok = false;
+            return;
         }
 
-        fclose(to_fp);
-        fclose(from_fp);
+        const int fd = open(paths[i].data(), O_RDONLY | O_CLOEXEC);
+        const ssize_t len = fd != -1 ? preadFull(fd, arena.buffer.get() + entry.offset, entry.length, 0) : -1;
 
-        return true;
-    }
+        if (len == -1) {
+            entry.error = errno;
+            entry.length = 0;
+            ok = false;
+        } else {
+            // Files which have shrunk in the meantime keep the gap
+            entry.length = static_cast<size_t>(len);
+        }
 
-    return false;
+        if (fd != -1) close(fd);
+    });
+
+    return ok;
 }
 
-/*static*/ bool
+/*static*/ int64_t
 FileSystem::
-createPath(string path, string &fail_path) {
-    if (!isAbsolutePath(path)) return false;
+pipeTransfer(int in_fd, int out_fd, error_code &error, int64_t length)
+{
+    constexpr size_t CHUNK = 1 << 20;
 
-#ifdef WIN
-#define PARTITION partition +
-    const string partition = path.substr(0, 2);
-    path = path.substr(2);
+    struct stat in_st {}, out_st {};
 
-    if (path.empty()) path = DIR_SEP;
-#else
-#define PARTITION
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        setError(error, errno);
+        return -1;
+    }
+
+    int64_t done = 0;
+
+    const auto remaining = [&]() {
+        return length < 0 ? CHUNK : static_cast<size_t>(min<int64_t>(length - done, CHUNK));
+    };
+
+#ifdef __linux__
+    // splice() moves pages into or out of a pipe without copying them to
+    // user space, sendfile() does the same between other descriptors
+    const bool use_splice = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+    ssize_t cnt = 0;
+
+    while (done != length) {
+        cnt = use_splice ? splice(in_fd, nullptr, out_fd, nullptr, remaining(), SPLICE_F_MOVE | SPLICE_F_MORE)
+                         : sendfile(out_fd, in_fd, nullptr, remaining());
+
+        if (cnt > 0) {
+            done += cnt;
+        } else if (cnt == 0 || errno != EINTR) {
+            break;
+        }
+    }
+
+    if (done == length || cnt == 0) {
+        error.clear();
+        return done;
+    }
+
+    if (errno != EINVAL && errno != ENOSYS) {
+        setError(error, errno);
+        return -1;
+    }
 #endif
 
-    DataContainer<string> directories = String::split(path, DIR_SEP);
+    unique_ptr<char[]> buf(new char[CHUNK]);
 
-    path.clear();
+    while (done != length) {
+        const ssize_t len = read(in_fd, buf.get(), remaining());
 
-    if (directories.empty())
-        path.append(DIR_SEP);
-    else {
-        for (auto itr = directories.begin(); itr != directories.end(); ++itr) {
-            if (itr->empty()) {
-                directories.erase(itr--);
-                continue;
-            }
+        if (len == 0) break;
 
-            path.append(DIR_SEP + *itr);
+        if (len == -1) {
+            if (errno == EINTR) continue;
 
-            if (exists(PARTITION path)) {
-                if (!isDir(PARTITION path)) {
-                    fail_path = PARTITION path;
-                    return false;
-                }
+            setError(error, errno);
+            return -1;
+        }
 
-                continue;
-            }
+        for (ssize_t written = 0; written != len;) {
+            const ssize_t cnt = write(out_fd, buf.get() + written, static_cast<size_t>(len - written));
 
-            if (!createDirectory(PARTITION path)) {
-                fail_path = PARTITION path;
-                return false;
+            if (cnt == -1) {
+                if (errno == EINTR) continue;
+
+                setError(error, errno);
+                return -1;
             }
+
+            written += cnt;
         }
-    }
 
-    return true;
+        done += len;
+    }
 
-#undef PARTITION
+    error.clear();
+    return done;
 }
 
-/*static*/ bool
+/*static*/ int64_t
 FileSystem::
-readFile(const string &path, string &content)
+sendFileTo(const string &source_path, int fd, error_code &error, int64_t offset, int64_t length)
 {
-    content.clear();
+    const int in_fd = open(source_path.data(), O_RDONLY | O_CLOEXEC);
 
-    const int64_t f_size = getFileSize(path);
+    if (in_fd == -1) {
+        setError(error, errno);
+        return -1;
+    }
+
+    int64_t cnt = -1;
 
-    if (f_size != -1) {
-        content.reserve(static_cast<uint32_t>(f_size));
+    if (offset != 0 && lseek(in_fd, offset, SEEK_SET) == -1) {
+        setError(error, errno);
+    } else {
+        cnt = pipeTransfer(in_fd, fd, error, length);
     }
 
-    ifstream file(path);
-    string line;
+    close(in_fd);
 
-    if (file.good()) {
-        while (getline(file, line)) {
-            content += line;
-            content += '\n';
-        }
+    return cnt;
+}
 
-        file.close();
-        return true;
+/*static*/ int64_t
+FileSystem::
+sendFileTo(const string &source_path, const string &target_path, error_code &error)
+{
+    // Regular targets are created or truncated like writeFile() does;
+    // FIFOs and devices are written as they are. Opening a FIFO blocks
+    // until the consumer opens it for reading
+    struct stat target_st;
+    int flags = O_WRONLY | O_CLOEXEC;
+
+    if (stat(target_path.data(), &target_st) != 0 || S_ISREG(target_st.st_mode))
+        flags |= O_CREAT | O_TRUNC;
+
+    const int out_fd = open(target_path.data(), flags, 0644);
+
+    if (out_fd == -1) {
+        setError(error, errno);
+        return -1;
     }
 
-    return false;
+    const int64_t cnt = sendFileTo(source_path, out_fd, error);
+
+    close(out_fd);
+
+    return cnt;
 }
 
+#endif
+
 /*static*/ bool
 FileSystem::
 writeFile(const string &path, const string &content, ofstream::openmode mode, time_t last_modified_time)
 {
+    error_code error;
+    return writeFile(path, content, mode, last_modified_time, error);
+}
+
+/*static*/ bool
+FileSystem::
+writeFile(const string &path, const string &content, ofstream::openmode mode, time_t last_modified_time,
+          error_code &error)
+{
+    errno = 0;
+
     ofstream file;
     file.open(path, mode);
 
@@ -266,10 +2266,13 @@ writeFile(const string &path, const string &content, ofstream::openmode mode, ti
         file << content;
         file.close();
 
+        if (!file.good()) return setError(error, errno);
+
+        error.clear();
         return true;
     }
 
-    return false;
+    return setError(error, errno);
 }
 
 /*static*/ bool
@@ -324,3 +2327,309 @@ getParentPath(const string &path)
 
     return parent_path;
 }
+
+#ifdef __linux__
+// Large enough to fetch a few thousand entries per system call
+static constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+
+DirectoryRange::
+DirectoryRange(const string &path) :
+    path(path),
+    fd(open(path.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+    buffer(fd != -1 ? new char[DIRENT_BUFFER_SIZE] : nullptr)
+{
+}
+
+DirectoryRange::
+DirectoryRange(DirectoryRange &&other) :
+    path(move(other.path)),
+    current(move(other.current)),
+    current_type(other.current_type),
+    started(other.started),
+    exhausted(other.exhausted),
+    fd(other.fd),
+    buffer(move(other.buffer)),
+    buffer_pos(other.buffer_pos),
+    buffer_len(other.buffer_len)
+{
+    other.fd = -1;
+    other.exhausted = true;
+}
+
+void
+DirectoryRange::
+close()
+{
+    if (fd != -1) ::close(fd);
+
+    fd = -1;
+    buffer.reset();
+    exhausted = true;
+}
+
+bool
+DirectoryRange::
+next()
+{
+    while (!exhausted) {
+        if (buffer_pos == buffer_len) {
+            const long cnt = fd != -1 ? syscall(SYS_getdents64, fd, buffer.get(), DIRENT_BUFFER_SIZE) : -1;
+
+            if (cnt <= 0) break;
+
+            buffer_pos = 0;
+            buffer_len = static_cast<size_t>(cnt);
+        }
+
+        const auto * const entry = reinterpret_cast<const LinuxDirent64*>(buffer.get() + buffer_pos);
+        const char * const name = static_cast<const char*>(entry->d_name);
+
+        buffer_pos += entry->d_reclen;
+
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            current = path + DIR_SEP + name;
+            current_type = entry->d_type;
+            return true;
+        }
+    }
+
+    close();
+    return false;
+}
+#else
+DirectoryRange::
+DirectoryRange(const string &path) :
+    path(path),
+    dir(opendir(path.data()))
+{
+}
+
+DirectoryRange::
+DirectoryRange(DirectoryRange &&other) :
+    path(move(other.path)),
+    current(move(other.current)),
+    current_type(other.current_type),
+    started(other.started),
+    exhausted(other.exhausted),
+    dir(other.dir)
+{
+    other.dir = nullptr;
+    other.exhausted = true;
+}
+
+void
+DirectoryRange::
+close()
+{
+    if (dir != nullptr) closedir(dir);
+
+    dir = nullptr;
+    exhausted = true;
+}
+
+bool
+DirectoryRange::
+next()
+{
+    dirent *entry;
+
+    while (!exhausted && dir != nullptr && bool(entry = readdir(dir))) {
+        const char * const name = static_cast<char*>(entry->d_name);
+
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            current = path + DIR_SEP + name;
+#ifdef _DIRENT_HAVE_D_TYPE
+            current_type = entry->d_type;
+#endif
+            return true;
+        }
+    }
+
+    close();
+    return false;
+}
+#endif
+
+DirectoryRange::
+~DirectoryRange()
+{
+    close();
+}
+
+DirectoryRange::iterator
+DirectoryRange::
+begin()
+{
+    // Input range: the first call reads the first entry, further calls
+    // continue at the current entry
+    if (!started) {
+        started = true;
+        next();
+    }
+
+    return exhausted ? end() : iterator(this);
+}
+
+bool
+InodeSet::
+insert(const struct stat &st, const string &path, string *first_path)
+{
+    const Key key {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+    Shard &shard = shards[KeyHash()(key) % SHARDS];
+
+    lock_guard<mutex> guard(shard.lock);
+
+    const auto result = shard.inodes.emplace(key, path);
+
+    if (!result.second && first_path != nullptr) *first_path = result.first->second;
+
+    return result.second;
+}
+
+bool
+InodeSet::
+contains(const struct stat &st) const
+{
+    const Key key {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)};
+    const Shard &shard = shards[KeyHash()(key) % SHARDS];
+
+    lock_guard<mutex> guard(shard.lock);
+
+    return shard.inodes.count(key) != 0;
+}
+
+FileContent::
+FileContent(FileContent &&other) :
+    buffer(move(other.buffer)),
+    mapping(other.mapping),
+    mapping_size(other.mapping_size)
+{
+    other.mapping = nullptr;
+    other.mapping_size = 0;
+}
+
+FileContent &
+FileContent::
+operator=(FileContent &&other)
+{
+    if (this != &other) {
+        clear();
+
+        buffer = move(other.buffer);
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+    }
+
+    return *this;
+}
+
+FileContent::
+~FileContent()
+{
+    clear();
+}
+
+void
+FileContent::
+clear()
+{
+#ifndef WIN
+    if (mapping != nullptr) munmap(mapping, mapping_size);
+#endif
+
+    buffer.clear();
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+#ifndef WIN
+ReverseLineReader::
+ReverseLineReader(const string &path, size_t block_size) :
+    fd(open(path.data(), O_RDONLY | O_CLOEXEC)),
+    block_size(max<size_t>(block_size, 1))
+{
+    struct stat st {};
+
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        exhausted = true;
+        return;
+    }
+
+    position = st.st_size;
+
+    char last = '\0';
+
+    if (position != 0 && pread(fd, &last, 1, position - 1) == 1 && last == '\n') --position;
+
+    exhausted = st.st_size == 0;
+}
+
+ReverseLineReader::
+~ReverseLineReader()
+{
+    if (fd != -1) close(fd);
+}
+
+bool
+ReverseLineReader::
+next(string &line)
+{
+    while (!exhausted) {
+        const char * const newline = findLastNewline(buffer.data() + start, unscanned);
+
+        if (newline != nullptr) {
+            const size_t line_start = static_cast<size_t>(newline - buffer.data());
+
+            line.assign(buffer, line_start + 1, end - line_start - 1);
+            end = line_start;
+            unscanned = line_start - start;
+
+            return true;
+        }
+
+        if (position == 0) {
+            line.assign(buffer, start, end - start);
+            string().swap(buffer);
+            exhausted = true;
+
+            return true;
+        }
+
+        const size_t len = static_cast<size_t>(min<off_t>(position, static_cast<off_t>(block_size)));
+
+        // Blocks are read in front of the pending bytes. Without room for
+        // the next one these are moved to the end of a buffer at least twice
+        // their size, so a line spanning many blocks is copied only a few
+        // times.
+        if (start < len) {
+            const size_t used = end - start;
+
+            if (buffer.size() < 2 * used + len) {
+                string grown(2 * used + len, '\0');
+
+                memcpy(&grown[grown.size() - used], buffer.data() + start, used);
+                buffer.swap(grown);
+            } else {
+                memmove(&buffer[buffer.size() - used], buffer.data() + start, used);
+            }
+
+            start = buffer.size() - used;
+            end = buffer.size();
+        }
+
+        if (preadFull(fd, &buffer[start - len], len, position - static_cast<off_t>(len)) != static_cast<ssize_t>(len)) {
+            exhausted = true;
+            break;
+        }
+
+        position -= static_cast<off_t>(len);
+        start -= len;
+        unscanned = len;
+    }
+
+    return false;
+}
+#endif
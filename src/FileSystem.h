@@ -43,49 +43,125 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <sys/stat.h>
+#include <system_error>
 #include <unistd.h>
+#include <unordered_map>
 
 #ifdef WIN
 #include <windows.h>
 #define DIR_SEP "\\"
 #else
+#include <sys/mman.h>
 #define DIR_SEP "/"
 #endif
 
+class FileArena;
+class FileContent;
+
 class FILESYSTEM_EXPORT FileSystem
 {
 public:
+    // Conditions for getDirectoryContents(). Name based conditions are
+    // checked before metadata conditions, which need one stat call per
+    // remaining entry. Unset conditions are ignored.
+    struct DirectoryFilter
+    {
+        enum EntryType {TYPE_ANY, TYPE_FILE, TYPE_DIRECTORY};
+
+        DataContainer<string> extensions;   // e.g. ".txt", case sensitive
+        string name_regex;                  // must match the whole name, an invalid one
+                                            // gives an empty result
+        EntryType type = TYPE_ANY;
+        int64_t min_size = -1, max_size = -1;
+        time_t min_mtime = 0, max_mtime = 0;
+    };
+
+    enum SortOrder {SORT_NONE, SORT_LEXICOGRAPHIC, SORT_NATURAL};
+
+    // RENAME_KEEP_EXISTING fails with EEXIST instead of replacing the new
+    // path, RENAME_SWAP exchanges both paths, which must exist
+    enum RenameMode {RENAME_OVERWRITE, RENAME_KEEP_EXISTING, RENAME_SWAP};
+
     static DataContainer<string>
-    getDirectoryContents(const string &path);
+    getDirectoryContents(const string &path),
+    getDirectoryContents(const string &path, const DirectoryFilter &filter),
+    getDirectoryPage    (const string &path, string &cursor, size_t page_size,
+                         SortOrder order = SORT_NONE),
+    glob                (const string &pattern);
 
     static inline bool
     exists              (const string &path),
     isReadable          (const string &path),
     isWritable          (const string &path),
-    isFile              (const string &path),
-    isDir               (const string &path),
+    isFile              (const string &path, bool follow_symlinks = true),
+    isDir               (const string &path, bool follow_symlinks = true),
+#ifndef WIN
+    isSymLink           (const string &path),
+#endif
     rename              (const string &current_path, const string &new_path),
+    rename              (const string &current_path, const string &new_path, error_code &error),
 #ifdef WIN
     createDirectory     (const string &path),
+    createDirectory     (const string &path, error_code &error),
 #else
     createDirectory     (const string &path, mode_t mode = 0775),
+    createDirectory     (const string &path, mode_t mode, error_code &error),
     createPipe			(const string &path),
 #endif
 	isEmptyDir          (const string &path),
     deleteFile			(const string &path),
+    deleteFile          (const string &path, error_code &error),
     isAbsolutePath      (const string &path);
 
     static bool
+    matchesPattern      (const string &pattern, const string &name),
+    copyTree            (const string &source_path, const string &target_path),
+#ifndef WIN
+    readLink            (const string &path, string &target),
+    // Makes created, renamed or removed entries of a directory durable
+    syncDirectory       (const string &path),
+#endif
     createPath          (string path, string &fail_path),
+    createPath          (string path, string &fail_path, error_code &error),
+    rename              (const string &current_path, const string &new_path, RenameMode mode,
+                         error_code &error),
+#ifndef WIN
+    moveFile            (const string &source_path, const string &target_path, error_code &error),
+    moveTree            (const string &source_path, const string &target_path, error_code &error,
+                         unsigned int threads = 0),
+#endif
     copyFile            (const string &source_path, const string &target_path),
+    copyFile            (const string &source_path, const string &target_path, error_code &error),
+#ifndef WIN
+    copyFileResumable   (const string &source_path, const string &target_path,
+                         size_t block_size = 8 << 20),
+    updateFile          (const string &source_path, const string &target_path,
+                         size_t block_size = 1 << 16),
+#endif
     readFile            (const string &path, string &content),
+    readFile            (const string &path, string &content, error_code &error,
+                         int64_t max_size = -1),
+    readFile            (const string &path, FileContent &content, error_code &error,
+                         int64_t map_threshold = 64 << 20),
+#ifndef WIN
+    // Reads from the current position or maps from the start, the caller
+    // keeps "fd" open
+    readFile            (int fd, FileContent &content, error_code &error,
+                         int64_t map_threshold = 64 << 20),
+#endif
     writeFile           (const string &path, const string &content,
                          ofstream::openmode mode = ios::out | ios::trunc,
                          time_t last_modified_time = 0),
+    writeFile           (const string &path, const string &content,
+                         ofstream::openmode mode, time_t last_modified_time,
+                         error_code &error),
     isRemoteAddress(const string &addr);
 
     static inline string
@@ -97,31 +173,265 @@ public:
     getCleanPath        (string path),
     getRelativePath     (string path1, string path2);
 
+#ifndef WIN
+    static string
+    getCanonicalPath    (const string &path);
+
+    static void
+    clearCanonicalPathCache();
+#endif
+
     static inline int64_t
     getFileSize         (const string &file_path);
+
+    static int64_t
+    getDiskUsage        (const string &path, bool follow_symlinks = false),
+    countEntries        (const string &path, int64_t limit = -1);
+
+#ifndef WIN
+    static DataContainer<string>
+    tail                (const string &path, size_t lines);
+
+    static int64_t
+    readFileInto        (const string &path, char *buffer, size_t capacity, error_code &error),
+    pipeTransfer        (int in_fd, int out_fd, error_code &error, int64_t length = -1),
+    sendFileTo          (const string &source_path, int fd, error_code &error,
+                         int64_t offset = 0, int64_t length = -1),
+    sendFileTo          (const string &source_path, const string &target_path, error_code &error);
+
+    static bool
+    readFileInto        (const string &path, DataContainer<char> &buffer, error_code &error),
+    readFiles           (const DataContainer<string> &paths, FileArena &arena,
+                         unsigned int threads = 0);
+#endif
+};
+
+// Input range over the entries of a directory, which are read on demand.
+// The directory is closed as soon as the range is exhausted or destroyed,
+// e.g. when leaving a range-based for loop early.
+class FILESYSTEM_EXPORT DirectoryRange
+{
+public:
+    class iterator
+    {
+    public:
+        typedef input_iterator_tag iterator_category;
+        typedef string value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const string *pointer;
+        typedef const string &reference;
+
+        explicit iterator(DirectoryRange *range = nullptr) : range(range) {}
+
+        reference operator*() const { return range->current; }
+        pointer operator->() const { return &range->current; }
+
+        iterator &operator++()
+        {
+            if (!range->next()) range = nullptr;
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const { return range == other.range; }
+        bool operator!=(const iterator &other) const { return range != other.range; }
+
+    private:
+        DirectoryRange *range;
+    };
+
+    explicit DirectoryRange(const string &path);
+    DirectoryRange(DirectoryRange &&other);
+    DirectoryRange(const DirectoryRange&) = delete;
+    DirectoryRange &operator=(const DirectoryRange&) = delete;
+    ~DirectoryRange();
+
+    iterator begin();
+    iterator end() { return iterator(); }
+
+    // d_type of the current entry, DT_UNKNOWN if not provided
+    unsigned char type() const { return current_type; }
+
+    void close();
+
+private:
+    bool next();
+
+    string path, current;
+    unsigned char current_type = 0;
+    bool started = false, exhausted = false;
+
+#ifdef __linux__
+    int fd;
+    unique_ptr<char[]> buffer;
+    size_t buffer_pos = 0, buffer_len = 0;
+#else
+    DIR *dir;
+#endif
 };
 
+// Thread-safe set of (device, inode) pairs to process hard linked files
+// only once and to detect directory loops. Lookups are spread over
+// independently locked shards.
+class FILESYSTEM_EXPORT InodeSet
+{
+public:
+    // Returns true, if the inode of "st" is inserted for the first time.
+    // Otherwise "first_path" receives the path it was inserted with.
+    bool
+    insert              (const struct stat &st, const string &path = string(),
+                         string *first_path = nullptr);
+
+    bool
+    contains            (const struct stat &st) const;
+
+private:
+    struct Key
+    {
+        uint64_t dev, ino;
+        bool operator==(const Key &other) const { return dev == other.dev && ino == other.ino; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const { return hash<uint64_t>()(key.ino * 0x9e3779b97f4a7c15ULL ^ key.dev); }
+    };
+
+    struct Shard
+    {
+        mutable mutex lock;
+        unordered_map<Key, string, KeyHash> inodes;
+    };
+
+    static constexpr size_t SHARDS = 64;
+
+    Shard shards[SHARDS];
+};
+
+// Raw contents of a file, either read into memory or, for large files,
+// mapped read-only so that the file is never held twice in memory
+class FILESYSTEM_EXPORT FileContent
+{
+public:
+    FileContent() = default;
+    FileContent(FileContent &&other);
+    FileContent &operator=(FileContent &&other);
+    FileContent(const FileContent&) = delete;
+    FileContent &operator=(const FileContent&) = delete;
+    ~FileContent();
+
+    const char *data() const { return mapping != nullptr ? static_cast<const char*>(mapping) : buffer.data(); }
+    size_t size() const { return mapping != nullptr ? mapping_size : buffer.size(); }
+    bool isMapped() const { return mapping != nullptr; }
+
+    void clear();
+
+private:
+    friend class FileSystem;
+
+    string buffer;
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+};
+
+// Contents of several files stored back to back in a single allocation,
+// filled by FileSystem::readFiles()
+class FILESYSTEM_EXPORT FileArena
+{
+public:
+    size_t count() const { return entries.size(); }
+
+    const char *data(size_t index) const { return buffer.get() + entries[index].offset; }
+    size_t size(size_t index) const { return entries[index].length; }
+    error_code error(size_t index) const { return error_code(entries[index].error, generic_category()); }
+
+private:
+    friend class FileSystem;
+
+    struct Entry
+    {
+        size_t offset, length;
+        int error;
+    };
+
+    unique_ptr<char[]> buffer;
+    DataContainer<Entry> entries;
+};
+
+#ifndef WIN
+// Reads the lines of a file from the last to the first one. Blocks are
+// read backwards from the end of the file, so the cost depends on the
+// lines read and not on the size of the file. A final newline does not
+// start another line.
+class FILESYSTEM_EXPORT ReverseLineReader
+{
+public:
+    explicit ReverseLineReader(const string &path, size_t block_size = 64 * 1024);
+    ReverseLineReader(const ReverseLineReader&) = delete;
+    ReverseLineReader &operator=(const ReverseLineReader&) = delete;
+    ~ReverseLineReader();
+
+    bool isOpen() const { return fd != -1; }
+
+    // Stores the previous line without its newline, false at the start
+    // of the file
+    bool
+    next                (string &line);
+
+private:
+    int fd;
+    size_t block_size;
+    off_t position = 0;     // file offset of the byte at "start"
+    string buffer;          // filled from its end, one block after another
+    size_t start = 0;       // first byte read into "buffer"
+    size_t end = 0;         // end of the bytes before the lines already returned
+    size_t unscanned = 0;   // bytes from "start" on not yet searched
+    bool exhausted = false;
+};
+#endif
+
 /*static*/ inline bool
 FileSystem::
-isFile(const string &path)
+isFile(const string &path, bool follow_symlinks)
 {
     struct stat path_stat {};
+#ifdef WIN
+    (void)follow_symlinks;
     stat(path.data(), &path_stat);
+#else
+    follow_symlinks ? stat(path.data(), &path_stat) : lstat(path.data(), &path_stat);
+#endif
 
     return S_ISREG(path_stat.st_mode) != 0;
 }
 
 /*static*/ inline bool
 FileSystem::
-isDir(const string &path)
+isDir(const string &path, bool follow_symlinks)
 {
     struct stat path_stat {};
+#ifdef WIN
+    (void)follow_symlinks;
     stat(path.data(), &path_stat);
+#else
+    follow_symlinks ? stat(path.data(), &path_stat) : lstat(path.data(), &path_stat);
+#endif
 
     const int res = S_ISDIR(path_stat.st_mode);
     return res != 0;
 }
 
+#ifndef WIN
+/*static*/ inline bool
+FileSystem::
+isSymLink(const string &path)
+{
+    struct stat path_stat {};
+    lstat(path.data(), &path_stat);
+
+    return S_ISLNK(path_stat.st_mode) != 0;
+}
+#endif
+
 /*static*/ inline bool
 FileSystem::
 exists(const string &path)
@@ -159,6 +469,19 @@ createDirectory(const string &path)
 {
     return mkdir(path.data()) == 0;
 }
+
+/*static*/ inline bool
+FileSystem::
+createDirectory(const string &path, error_code &error)
+{
+    if (mkdir(path.data()) == 0) {
+        error.clear();
+        return true;
+    }
+
+    error.assign(errno, generic_category());
+    return false;
+}
 #else
 /*static*/ inline bool
 FileSystem::
@@ -166,23 +489,26 @@ createDirectory(const string &path, mode_t mode)
 {
     return mkdir(path.data(), mode) == 0;
 }
-#endif
 
 /*static*/ inline bool
 FileSystem::
-isEmptyDir(const string &path)
+createDirectory(const string &path, mode_t mode, error_code &error)
 {
-    char cnt = 0;
-    DIR *dir = opendir(path.data());
-
-    while (bool(readdir(dir))) {
-        if (++cnt > 2) {
-            closedir(dir);
-            return false;
-        }
+    if (mkdir(path.data(), mode) == 0) {
+        error.clear();
+        return true;
     }
 
-    return true;
+    error.assign(errno, generic_category());
+    return false;
+}
+#endif
+
+/*static*/ inline bool
+FileSystem::
+isEmptyDir(const string &path)
+{
+    return countEntries(path, 1) == 0;
 }
 
 /*static*/ inline bool
@@ -192,6 +518,19 @@ deleteFile(const string &path)
     return remove(path.data()) == 0;
 }
 
+/*static*/ inline bool
+FileSystem::
+deleteFile(const string &path, error_code &error)
+{
+    if (remove(path.data()) == 0) {
+        error.clear();
+        return true;
+    }
+
+    error.assign(errno, generic_category());
+    return false;
+}
+
 /*static*/ inline bool
 FileSystem::
 isAbsolutePath(const string &path)
@@ -223,6 +562,19 @@ rename(const string &current_path, const string &new_path)
     return std::rename(current_path.data(), new_path.data()) == 0;
 }
 
+/*static*/ inline bool
+FileSystem::
+rename(const string &current_path, const string &new_path, error_code &error)
+{
+    if (std::rename(current_path.data(), new_path.data()) == 0) {
+        error.clear();
+        return true;
+    }
+
+    error.assign(errno, generic_category());
+    return false;
+}
+
 #ifndef WIN
 /*static*/ inline bool
 FileSystem::
@@ -0,0 +1,191 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "Follower.h"
+
+#ifndef WIN
+#include <cerrno>
+#include <chrono>
+#include <poll.h>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Interval to check for changes without inotify
+static constexpr int POLL_INTERVAL_MS = 100;
+
+// Bytes read per call at most, a large backlog is returned in parts
+static constexpr int64_t MAX_READ_SIZE = 4 << 20;
+
+Follower::
+Follower(const string &path, bool from_end) :
+    path(path),
+    fd(open(path.data(), O_RDONLY | O_CLOEXEC))
+{
+    struct stat st {};
+
+    if (from_end && fd != -1 && fstat(fd, &st) == 0) position = st.st_size;
+
+#ifdef __linux__
+    // Watching the directory catches modifications as well as the file
+    // being replaced, which a watch on the file itself would miss
+    const string directory = FileSystem::getParentPath(path);
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (notify_fd != -1 &&
+        inotify_add_watch(notify_fd, directory.empty() ? "." : directory.data(),
+                          IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB) == -1) {
+        close(notify_fd);
+        notify_fd = -1;
+    }
+#endif
+}
+
+Follower::
+~Follower()
+{
+    if (notify_fd != -1) close(notify_fd);
+    if (fd != -1) close(fd);
+}
+
+int64_t
+Follower::
+read(string &data, int timeout_ms)
+{
+    const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(max(timeout_ms, 0));
+
+    for (;;) {
+        const int64_t cnt = readAvailable(data);
+
+        if (cnt != 0 || timeout_ms == 0) return cnt;
+
+        int remaining = -1;
+
+        if (timeout_ms > 0) {
+            const auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+
+            if (left.count() <= 0) return 0;
+
+            remaining = static_cast<int>(left.count());
+        }
+
+        if (!waitForChange(remaining)) return -1;
+    }
+}
+
+int64_t
+Follower::
+readAvailable(string &data)
+{
+    // Files may be missing temporarily during rotation
+    if (fd == -1) {
+        fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+        position = 0;
+
+        if (fd == -1) return 0;
+    }
+
+    for (int attempt = 0; attempt != 2; ++attempt) {
+        struct stat st {};
+
+        if (fstat(fd, &st) != 0) {
+            follow_error.assign(errno, generic_category());
+            return -1;
+        }
+
+        if (st.st_size < position) position = 0;
+
+        if (st.st_size > position) {
+            const size_t old_size = data.size();
+            const size_t len = static_cast<size_t>(min<int64_t>(st.st_size - position, MAX_READ_SIZE));
+
+            data.resize(old_size + len);
+
+            ssize_t cnt;
+
+            while ((cnt = pread(fd, &data[old_size], len, position)) == -1 && errno == EINTR);
+
+            if (cnt == -1) {
+                data.resize(old_size);
+                follow_error.assign(errno, generic_category());
+                return -1;
+            }
+
+            data.resize(old_size + static_cast<size_t>(cnt));
+            position += cnt;
+
+            return cnt;
+        }
+
+        // The current file is read completely, continue with a new file
+        // under the same path
+        struct stat path_st {};
+
+        if (stat(path.data(), &path_st) != 0 || (path_st.st_dev == st.st_dev && path_st.st_ino == st.st_ino)) {
+            return 0;
+        }
+
+        const int new_fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+
+        if (new_fd == -1) return 0;
+
+        close(fd);
+        fd = new_fd;
+        position = 0;
+    }
+
+    return 0;
+}
+
+bool
+Follower::
+waitForChange(int timeout_ms)
+{
+#ifdef __linux__
+    if (notify_fd != -1) {
+        pollfd pfd {notify_fd, POLLIN, 0};
+        int res;
+
+        while ((res = poll(&pfd, 1, timeout_ms)) == -1 && errno == EINTR);
+
+        if (res == -1) {
+            follow_error.assign(errno, generic_category());
+            return false;
+        }
+
+        // Only wake-ups matter, discard the queued events
+        alignas(inotify_event) char buf[4096];
+
+        while (::read(notify_fd, static_cast<char*>(buf), sizeof(buf)) > 0);
+
+        return true;
+    }
+#endif
+
+    this_thread::sleep_for(chrono::milliseconds(timeout_ms < 0 ? POLL_INTERVAL_MS : min(timeout_ms, POLL_INTERVAL_MS)));
+
+    return true;
+}
+#endif
@@ -0,0 +1,67 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef FOLLOWER_H
+#define FOLLOWER_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+// Follows a growing file like "tail -F". Only bytes appended since the
+// last call are read. On Linux it sleeps on inotify events of the
+// file's directory instead of polling. A file truncated below the current
+// offset is read again from its start; a file replaced by rotation is read
+// to its end before continuing with the new file from its start.
+class FILESYSTEM_EXPORT Follower
+{
+public:
+    // Starts at the current end of the file, or at its beginning
+    explicit Follower(const string &path, bool from_end = true);
+    Follower(const Follower&) = delete;
+    Follower &operator=(const Follower&) = delete;
+    ~Follower();
+
+    // Appends new bytes to "data", waiting up to "timeout_ms" for them,
+    // -1 waits indefinitely. At most 4 MiB are read per call, the rest is
+    // returned by the next calls without waiting. Returns the number of
+    // bytes, 0 on timeout and -1 on errors.
+    int64_t
+    read                (string &data, int timeout_ms = -1);
+
+    int64_t offset() const { return position; }
+    const error_code &error() const { return follow_error; }
+
+private:
+    int64_t
+    readAvailable       (string &data);
+
+    bool
+    waitForChange       (int timeout_ms);
+
+    string path;
+    int fd = -1;
+    int64_t position = 0;
+    int notify_fd = -1;
+    error_code follow_error;
+};
+#endif
+
+#endif // FOLLOWER_H
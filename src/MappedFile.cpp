@@ -0,0 +1,159 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "MappedFile.h"
+
+#ifndef WIN
+#include <cerrno>
+
+MappedFile::
+MappedFile(const string &path, size_t size, mode_t mode) :
+    fd(open(path.data(), O_RDWR | O_CREAT | O_CLOEXEC, mode))
+{
+    struct stat st {};
+
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        map_error.assign(errno, generic_category());
+
+        if (fd != -1) close(fd);
+
+        fd = -1;
+        return;
+    }
+
+    if (size > static_cast<size_t>(st.st_size)) {
+        resize(size);
+    } else {
+        map(static_cast<size_t>(st.st_size));
+    }
+}
+
+MappedFile::
+MappedFile(MappedFile &&other) :
+    fd(other.fd),
+    mapping(other.mapping),
+    mapping_size(other.mapping_size),
+    map_error(other.map_error)
+{
+    other.fd = -1;
+    other.mapping = nullptr;
+    other.mapping_size = 0;
+}
+
+MappedFile::
+~MappedFile()
+{
+    if (mapping != nullptr) munmap(mapping, mapping_size);
+    if (fd != -1) close(fd);
+}
+
+bool
+MappedFile::
+resize(size_t size)
+{
+    if (fd == -1) return false;
+
+    if (size > mapping_size) {
+        const int res = posix_fallocate(fd, static_cast<off_t>(mapping_size), static_cast<off_t>(size - mapping_size));
+
+        // Not every file system can reserve blocks
+        if (res != 0 && (res != EOPNOTSUPP && res != EINVAL)) {
+            map_error.assign(res, generic_category());
+            return false;
+        }
+
+        if (res != 0 && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            map_error.assign(errno, generic_category());
+            return false;
+        }
+
+        return map(size);
+    }
+
+    // Unmap the pages to be cut off before shrinking the file
+    if (!map(size)) return false;
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        map_error.assign(errno, generic_category());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+MappedFile::
+sync(size_t offset, size_t length, bool wait)
+{
+    // Nothing mapped, nothing to write back
+    if (mapping == nullptr) return fd != -1;
+    if (offset >= mapping_size) return false;
+
+    if (length == 0 || length > mapping_size - offset) length = mapping_size - offset;
+
+    // msync() needs a page aligned start address
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t start = offset / page_size * page_size;
+
+    if (msync(mapping + start, length + offset - start, wait ? MS_SYNC : MS_ASYNC) != 0) {
+        map_error.assign(errno, generic_category());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+MappedFile::
+map(size_t size)
+{
+    if (size == mapping_size) return true;
+
+    void *new_mapping;
+
+    if (size == 0) {
+        new_mapping = nullptr;
+        munmap(mapping, mapping_size);
+    } else if (mapping == nullptr) {
+        new_mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+#ifdef __linux__
+        new_mapping = mremap(mapping, mapping_size, size, MREMAP_MAYMOVE);
+#else
+        new_mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (new_mapping != MAP_FAILED) munmap(mapping, mapping_size);
+#endif
+    }
+
+    if (new_mapping == MAP_FAILED) {
+        map_error.assign(errno, generic_category());
+        return false;
+    }
+
+    mapping = static_cast<char*>(new_mapping);
+    mapping_size = size;
+    map_error.clear();
+
+    return true;
+}
+#endif
@@ -0,0 +1,157 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+#include <type_traits>
+
+// File mapped shared and writable, so changes go directly to the page
+// cache and reach the file without an extra copy. Growing reserves the
+// blocks with fallocate() where supported, so running out of space fails
+// in resize() instead of raising SIGBUS on first access.
+class FILESYSTEM_EXPORT MappedFile
+{
+public:
+    // Opens or creates "path" and grows it to at least "size" bytes
+    explicit MappedFile(const string &path, size_t size = 0, mode_t mode = 0644);
+    MappedFile(MappedFile &&other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool isOpen() const { return fd != -1; }
+
+    char *data() { return mapping; }
+    const char *data() const { return mapping; }
+    size_t size() const { return mapping_size; }
+
+    const error_code &error() const { return map_error; }
+
+    // Changes the file size and remaps, the mapping may move
+    bool
+    resize              (size_t size),
+    // Writes back the pages of the range, "length" 0 means up to the end
+    sync                (size_t offset = 0, size_t length = 0, bool wait = true);
+
+private:
+    bool
+    map                 (size_t size);
+
+    int fd;
+    char *mapping = nullptr;
+    size_t mapping_size = 0;
+    error_code map_error;
+};
+
+// Vector of trivially copyable elements stored in a MappedFile. Capacity
+// grows geometrically, the file is cut to the elements in use on
+// destruction, and reopening it restores them. The element count lives
+// only in the file size, so after a crash the file keeps its capacity
+// and reopening it yields the unused, zeroed or stale, slots as well.
+template<typename T>
+class MappedVector
+{
+    static_assert(is_trivially_copyable<T>::value, "MappedVector needs trivially copyable elements");
+
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    explicit MappedVector(const string &path, mode_t mode = 0644) :
+        file(path, 0, mode),
+        count(file.size() / sizeof(T))
+    {
+    }
+
+    MappedVector(MappedVector &&other) = default;
+    MappedVector(const MappedVector&) = delete;
+    MappedVector &operator=(const MappedVector&) = delete;
+
+    ~MappedVector()
+    {
+        if (file.isOpen()) file.resize(count * sizeof(T));
+    }
+
+    bool isOpen() const { return file.isOpen(); }
+    const error_code &error() const { return file.error(); }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return file.size() / sizeof(T); }
+    bool empty() const { return count == 0; }
+
+    T *data() { return reinterpret_cast<T*>(file.data()); }
+    const T *data() const { return reinterpret_cast<const T*>(file.data()); }
+
+    T &operator[](size_t index) { return data()[index]; }
+    const T &operator[](size_t index) const { return data()[index]; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + count; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + count; }
+
+    bool reserve(size_t new_capacity)
+    {
+        return new_capacity <= capacity() || file.resize(new_capacity * sizeof(T));
+    }
+
+    bool resize(size_t new_size)
+    {
+        if (new_size > capacity() && !reserve(max(new_size, capacity() * 2))) return false;
+
+        // Space reused after shrinking may still hold old elements
+        if (new_size > count) memset(static_cast<void*>(data() + count), 0, (new_size - count) * sizeof(T));
+
+        count = new_size;
+        return true;
+    }
+
+    bool push_back(const T &value)
+    {
+        // "value" may be an element, which growing can unmap
+        const T copy = value;
+
+        if (count == capacity() && !reserve(max<size_t>(capacity() * 2, 4096 / sizeof(T) + 1))) return false;
+
+        memcpy(static_cast<void*>(data() + count++), &copy, sizeof(T));
+        return true;
+    }
+
+    void pop_back() { --count; }
+    void clear() { count = 0; }
+
+    bool shrink_to_fit() { return file.resize(count * sizeof(T)); }
+
+    // Writes back the elements, not the count, see above
+    bool sync(bool wait = true) { return file.sync(0, count * sizeof(T), wait); }
+
+private:
+    MappedFile file;
+    size_t count;
+};
+#endif
+
+#endif // MAPPEDFILE_H
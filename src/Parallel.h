@@ -0,0 +1,56 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "FileSystem.h"
+#include <atomic>
+#include <thread>
+
+// Calls work(index) for every index in [0, count), spread over "threads"
+// threads including the calling one. 0 threads means one per core. Indices
+// are handed out in groups of "chunk".
+template<typename Work>
+static void
+runParallel(size_t count, unsigned int threads, const Work &work, size_t chunk = 16)
+{
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+
+    const size_t workers = min<size_t>(threads, (count + chunk - 1) / chunk);
+    atomic<size_t> next(0);
+
+    const auto run = [&]() {
+        for (size_t first; (first = next.fetch_add(chunk)) < count;) {
+            for (size_t i = first; i != min(first + chunk, count); ++i) work(i);
+        }
+    };
+
+    DataContainer<thread> pool;
+
+    for (size_t i = 1; i < workers; ++i) pool.emplace_back(run);
+
+    run();
+
+    for (auto &t : pool) t.join();
+}
+
+#endif // PARALLEL_H
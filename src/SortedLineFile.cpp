@@ -0,0 +1,283 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "SortedLineFile.h"
+
+#ifndef WIN
+#include <cerrno>
+#include <cstdio>
+
+static constexpr char SORTED_INDEX_MAGIC[8] = {'F', 'S', 'S', 'L', 'I', '2', '\0', '\0'};
+
+// Identifies the version of the file an index was built for. A rewrite of
+// the same size within the same second still changes the nanoseconds, a
+// replacement the inode.
+static void
+fileVersion(const struct stat &st, uint64_t version[4])
+{
+    version[0] = static_cast<uint64_t>(st.st_size);
+    version[1] = static_cast<uint64_t>(st.st_mtim.tv_sec);
+    version[2] = static_cast<uint64_t>(st.st_mtim.tv_nsec);
+    version[3] = static_cast<uint64_t>(st.st_ino);
+}
+
+SortedLineFile::
+SortedLineFile(const string &path, char separator, bool prefetch) :
+    path(path),
+    separator(separator),
+    prefetch_pages(prefetch)
+{
+    const int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+
+    // The version recorded for the index and the mapped data must come
+    // from the same file, even if "path" is replaced meanwhile
+    if (fd == -1 || fstat(fd, &file_st) != 0) {
+        open_error.assign(errno, generic_category());
+
+        if (fd != -1) close(fd);
+        return;
+    }
+
+    // Always map, only the probed pages are read
+    const bool res = FileSystem::readFile(fd, content, open_error, 0);
+
+    close(fd);
+
+    if (!res) return;
+
+    if (content.isMapped()) madvise(const_cast<char*>(content.data()), content.size(), MADV_RANDOM);
+
+    loadIndex();
+}
+
+bool
+SortedLineFile::
+find(const string &key, string &line) const
+{
+    const size_t start = lowerBound(key);
+
+    if (start == content.size() || compareKey(start, key, false) != 0) return false;
+
+    line.assign(content.data() + start, lineEnd(start) - start);
+
+    return true;
+}
+
+DataContainer<string>
+SortedLineFile::
+findPrefix(const string &prefix) const
+{
+    DataContainer<string> lines;
+
+    // Keys starting with "prefix" follow each other from its lower bound on
+    for (size_t start = lowerBound(prefix); start != content.size() && compareKey(start, prefix, true) == 0;) {
+        const size_t end = lineEnd(start);
+
+        lines.emplace_back(content.data() + start, end - start);
+        start = min(end + 1, content.size());
+    }
+
+    return lines;
+}
+
+bool
+SortedLineFile::
+buildIndex(size_t block_size)
+{
+    if (open_error) return false;
+
+    DataContainer<IndexEntry> entries;
+    const char * const data = content.data();
+
+    // The first line starting at or after each block boundary
+    for (size_t start = 0; start < content.size();) {
+        const size_t end = lineEnd(start);
+        const char * const sep = static_cast<const char*>(memchr(data + start, separator, end - start));
+
+        entries.push_back(IndexEntry {start, string(data + start, sep != nullptr ? sep : data + end)});
+
+        const size_t next = start + max<size_t>(block_size, 1);
+
+        if (next >= content.size()) break;
+
+        const char * const newline = static_cast<const char*>(memchr(data + next - 1, '\n', content.size() - next + 1));
+
+        if (newline == nullptr) break;
+
+        start = static_cast<size_t>(newline - data) + 1;
+    }
+
+    const string index_path = path + ".idx";
+    const string tmp_path = index_path + ".tmp";
+    FILE * const fp = fopen(tmp_path.data(), "we");
+
+    if (fp == nullptr) return false;
+
+    uint64_t header[5];
+
+    fileVersion(file_st, header);
+    header[4] = entries.size();
+
+    bool ok = fwrite(SORTED_INDEX_MAGIC, sizeof(SORTED_INDEX_MAGIC), 1, fp) == 1 &&
+              fwrite(header, sizeof(header), 1, fp) == 1;
+
+    for (auto itr = entries.begin(); ok && itr != entries.end(); ++itr) {
+        const uint64_t key_length = itr->key.size();
+
+        ok = fwrite(&itr->offset, sizeof(itr->offset), 1, fp) == 1 &&
+             fwrite(&key_length, sizeof(key_length), 1, fp) == 1 &&
+             fwrite(itr->key.data(), 1, itr->key.size(), fp) == itr->key.size();
+    }
+
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || !FileSystem::rename(tmp_path, index_path)) {
+        FileSystem::deleteFile(tmp_path);
+        return false;
+    }
+
+    index.swap(entries);
+
+    return true;
+}
+
+size_t
+SortedLineFile::
+lowerBound(const string &key) const
+{
+    size_t lo = 0, hi = content.size();
+
+    // Narrow down to the block between the last index entry below the key
+    // and the first one not below it
+    if (!index.empty()) {
+        const auto itr = lower_bound(index.begin(), index.end(), key,
+                                     [](const IndexEntry &entry, const string &k) { return entry.key < k; });
+
+        if (itr != index.begin()) lo = static_cast<size_t>(prev(itr)->offset);
+        if (itr != index.end()) hi = static_cast<size_t>(itr->offset);
+    }
+
+    // lo and hi stay line starts, the result lies in [lo, hi]
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const char * const newline = static_cast<const char*>(memrchr(content.data() + lo, '\n', mid - lo));
+        const size_t start = newline != nullptr ? static_cast<size_t>(newline - content.data()) + 1 : lo;
+
+        if (compareKey(start, key, false) < 0) {
+            lo = min(lineEnd(start) + 1, content.size());
+        } else {
+            hi = start;
+        }
+
+        if (prefetch_pages) prefetch(lo, hi);
+    }
+
+    return lo;
+}
+
+size_t
+SortedLineFile::
+lineEnd(size_t start) const
+{
+    const char * const newline = static_cast<const char*>(memchr(content.data() + start, '\n', content.size() - start));
+
+    return newline != nullptr ? static_cast<size_t>(newline - content.data()) : content.size();
+}
+
+int
+SortedLineFile::
+compareKey(size_t start, const string &key, bool prefix) const
+{
+    const char * const line = content.data() + start;
+    const size_t end = lineEnd(start);
+    const char * const sep = static_cast<const char*>(memchr(line, separator, end - start));
+    const size_t len = sep != nullptr ? static_cast<size_t>(sep - line) : end - start;
+
+    const int cmp = memcmp(line, key.data(), min(len, key.size()));
+
+    if (cmp != 0) return cmp;
+    if (len < key.size()) return -1;
+
+    return prefix || len == key.size() ? 0 : 1;
+}
+
+void
+SortedLineFile::
+prefetch(size_t lo, size_t hi) const
+{
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // The last probes share their pages with the current one
+    if (!content.isMapped() || hi - lo < 2 * page_size) return;
+
+    // Both halves are candidates for the next probe
+    for (const size_t probe : {lo + (hi - lo) / 4, lo + (hi - lo) / 4 * 3}) {
+        const size_t page = probe / page_size * page_size;
+
+        madvise(const_cast<char*>(content.data()) + page, page_size, MADV_WILLNEED);
+    }
+}
+
+bool
+SortedLineFile::
+loadIndex()
+{
+    FILE * const fp = fopen((path + ".idx").data(), "re");
+
+    if (fp == nullptr) return false;
+
+    char magic[sizeof(SORTED_INDEX_MAGIC)];
+    uint64_t header[5], version[4];
+
+    fileVersion(file_st, version);
+
+    // Index files of a different version of the file are ignored
+    bool ok = fread(magic, sizeof(magic), 1, fp) == 1 &&
+              memcmp(magic, SORTED_INDEX_MAGIC, sizeof(magic)) == 0 &&
+              fread(header, sizeof(header), 1, fp) == 1 &&
+              memcmp(header, version, sizeof(version)) == 0;
+
+    DataContainer<IndexEntry> entries;
+
+    for (uint64_t i = 0; ok && i != header[4]; ++i) {
+        IndexEntry entry;
+        uint64_t key_length = 0;
+
+        ok = fread(&entry.offset, sizeof(entry.offset), 1, fp) == 1 &&
+             fread(&key_length, sizeof(key_length), 1, fp) == 1 &&
+             entry.offset < content.size() && key_length <= content.size();
+
+        if (ok) {
+            entry.key.resize(static_cast<size_t>(key_length));
+            ok = key_length == 0 || fread(&entry.key[0], 1, entry.key.size(), fp) == entry.key.size();
+        }
+
+        if (ok) entries.push_back(move(entry));
+    }
+
+    fclose(fp);
+
+    if (ok) index.swap(entries);
+
+    return ok;
+}
+#endif
@@ -0,0 +1,83 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef SORTEDLINEFILE_H
+#define SORTEDLINEFILE_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+// Lookups in a text file whose lines are sorted bytewise by their key, as
+// "LC_ALL=C sort" does. The key is the part of a line before "separator",
+// or the whole line if it has none. The file is mapped and searched
+// binary over line boundaries, touching O(log n) pages per lookup. A
+// sparse index of every block's first key, stored next to the file by
+// buildIndex(), narrows the search to a single block beforehand.
+// Prefetching asks the kernel to read the pages of both possible next
+// probes ahead, which pays off for files not in the page cache yet.
+class FILESYSTEM_EXPORT SortedLineFile
+{
+public:
+    explicit SortedLineFile(const string &path, char separator = '\t', bool prefetch = false);
+
+    bool isOpen() const { return !open_error; }
+    const error_code &error() const { return open_error; }
+
+    bool
+    find                (const string &key, string &line) const,
+    // Writes an index with one entry every "block_size" bytes to
+    // "<path>.idx", which later instances load if the file is unchanged
+    buildIndex          (size_t block_size = 64 * 1024);
+
+    DataContainer<string>
+    findPrefix          (const string &prefix) const;
+
+private:
+    struct IndexEntry
+    {
+        uint64_t offset;
+        string key;
+    };
+
+    size_t
+    lowerBound          (const string &key) const,
+    lineEnd             (size_t start) const;
+
+    int
+    compareKey          (size_t start, const string &key, bool prefix) const;
+
+    void
+    prefetch            (size_t lo, size_t hi) const;
+
+    bool
+    loadIndex           ();
+
+    string path;
+    char separator;
+    bool prefetch_pages;
+    FileContent content;
+    struct stat file_st {};
+    DataContainer<IndexEntry> index;
+    error_code open_error;
+};
+#endif
+
+#endif // SORTEDLINEFILE_H
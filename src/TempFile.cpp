@@ -0,0 +1,210 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+
+#include "TempFile.h"
+
+#ifndef WIN
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+
+static atomic<unsigned int> link_counter(0);
+
+// umask() can only be read by changing it, which races with files created
+// by other threads meanwhile. Linux reports it in /proc since 4.7.
+static mode_t
+currentUmask()
+{
+#ifdef __linux__
+    FILE * const fp = fopen("/proc/self/status", "re");
+
+    if (fp != nullptr) {
+        char line[256];
+        unsigned int mask;
+        bool found = false;
+
+        while (!found && fgets(static_cast<char*>(line), sizeof(line), fp) != nullptr) {
+            found = sscanf(static_cast<char*>(line), "Umask: %o", &mask) == 1;
+        }
+
+        fclose(fp);
+
+        if (found) return static_cast<mode_t>(mask);
+    }
+#endif
+
+    const mode_t mask = umask(0);
+    umask(mask);
+
+    return mask;
+}
+
+TempFile::
+TempFile(const string &directory, mode_t mode) :
+    fd(-1)
+{
+#ifdef O_TMPFILE
+    fd = open(directory.data(), O_TMPFILE | O_RDWR | O_CLOEXEC, mode);
+
+    if (fd != -1) return;
+
+    // Only fall back, if the file system does not support O_TMPFILE
+    if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+        temp_error.assign(errno, generic_category());
+        return;
+    }
+#endif
+
+    temp_path = directory + DIR_SEP + ".tmpXXXXXX";
+    fd = mkostemp(&temp_path[0], O_CLOEXEC);
+
+    // mkostemp() creates the file with 0600, apply the umask like open()
+    if (fd == -1 || fchmod(fd, mode & ~currentUmask()) != 0) {
+        temp_error.assign(errno, generic_category());
+
+        if (fd != -1) {
+            close(fd);
+            unlink(temp_path.data());
+            fd = -1;
+        }
+    }
+}
+
+TempFile::
+~TempFile()
+{
+    if (fd != -1) close(fd);
+    if (!published && !temp_path.empty()) unlink(temp_path.data());
+}
+
+bool
+TempFile::
+isOpen() const
+{
+    return fd != -1;
+}
+
+int
+TempFile::
+descriptor() const
+{
+    return fd;
+}
+
+const error_code &
+TempFile::
+error() const
+{
+    return temp_error;
+}
+
+bool
+TempFile::
+write(const string &content)
+{
+    return write(content.data(), content.size());
+}
+
+bool
+TempFile::
+write(const char *data, size_t len)
+{
+    while (len != 0) {
+        const ssize_t cnt = ::write(fd, data, len);
+
+        if (cnt == -1) {
+            if (errno == EINTR) continue;
+
+            temp_error.assign(errno, generic_category());
+            return false;
+        }
+
+        data += cnt;
+        len -= static_cast<size_t>(cnt);
+    }
+
+    return true;
+}
+
+bool
+TempFile::
+publish(const string &target_path, bool replace)
+{
+    if (fd == -1 || published) {
+        temp_error = make_error_code(errc::bad_file_descriptor);
+        return false;
+    }
+
+    if (fsync(fd) != 0) {
+        temp_error.assign(errno, generic_category());
+        return false;
+    }
+
+    if (!temp_path.empty()) {
+        // rename() replaces atomically, link() refuses existing targets
+        const bool ok = replace ? ::rename(temp_path.data(), target_path.data()) == 0
+                                : link(temp_path.data(), target_path.data()) == 0 && unlink(temp_path.data()) == 0;
+
+        if (!ok) {
+            temp_error.assign(errno, generic_category());
+            return false;
+        }
+    } else {
+        const string fd_path = "/proc/self/fd/" + to_string(fd);
+
+        if (linkat(AT_FDCWD, fd_path.data(), AT_FDCWD, target_path.data(), AT_SYMLINK_FOLLOW) != 0) {
+            if (errno != EEXIST || !replace) {
+                temp_error.assign(errno, generic_category());
+                return false;
+            }
+
+            // linkat() cannot replace, link under a unique name next to
+            // the target and rename that onto it
+            string link_path;
+            int res;
+
+            do {
+                link_path = target_path + ".tmp" + to_string(getpid()) + "." + to_string(link_counter++);
+            } while ((res = linkat(AT_FDCWD, fd_path.data(), AT_FDCWD, link_path.data(), AT_SYMLINK_FOLLOW)) != 0 &&
+                     errno == EEXIST);
+
+            if (res != 0 || ::rename(link_path.data(), target_path.data()) != 0) {
+                temp_error.assign(errno, generic_category());
+                if (res == 0) unlink(link_path.data());
+                return false;
+            }
+        }
+    }
+
+    published = true;
+
+    // The new name is only durable with its directory entry
+    if (!FileSystem::syncDirectory(FileSystem::getParentPath(target_path))) {
+        temp_error.assign(errno, generic_category());
+        return false;
+    }
+
+    temp_error.clear();
+
+    return true;
+}
+#endif
@@ -0,0 +1,64 @@
+/******************************************************************************
+FileSystemLibrary - A C++11 file system library mainly based on C functions
+                    to increase portability
+
+Copyright (C) 2019-2020 Waldemar Zimpel <hspp@utilizer.de>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+
+#ifndef TEMPFILE_H
+#define TEMPFILE_H
+
+#include "FileSystem.h"
+
+#ifndef WIN
+// Unnamed file in "directory", which only becomes visible under its final
+// name with publish(). Uses O_TMPFILE where the file system supports it,
+// so nothing is left behind after a crash. Otherwise a hidden file created
+// by mkstemp() is used and removed again, if it has not been published.
+class FILESYSTEM_EXPORT TempFile
+{
+public:
+    explicit TempFile(const string &directory, mode_t mode = 0644);
+    TempFile(const TempFile&) = delete;
+    TempFile &operator=(const TempFile&) = delete;
+    ~TempFile();
+
+    bool
+    isOpen              () const,
+    write               (const string &content),
+    write               (const char *data, size_t len),
+    // Flushes the content to disk, links the file to "target_path" and
+    // syncs its directory. Without "replace" an existing target fails with
+    // EEXIST. A failing directory sync is reported, the file is published
+    // nevertheless.
+    publish             (const string &target_path, bool replace = true);
+
+    int
+    descriptor          () const;
+
+    const error_code &
+    error               () const;
+
+private:
+    int fd;
+    string temp_path;   // empty for O_TMPFILE files
+    bool published = false;
+    error_code temp_error;
+};
+#endif
+
+#endif // TEMPFILE_H